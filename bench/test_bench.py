@@ -1,3 +1,5 @@
+from concurrent.futures import ThreadPoolExecutor
+
 import numpy as np
 import pytest
 
@@ -8,6 +10,7 @@ TEST_BENCHMARK_SETTINGS = {
     "4k": {"group": "1024 of 4096", "warmup": False},
     "50k": {"group": "4096 of 50000", "warmup": False},
     "100k": {"group": "50000 of 100000", "warmup": False, "min_rounds": 3},
+    "threads": {"group": "8 x 1024 of 4096, 8 threads", "warmup": False},
 }
 TEST_CASE_SETTINGS = {
     "4k": (4096, 1024, 3),
@@ -187,3 +190,153 @@ def test_bucket_fps_kdline_100k_h9(benchmark):
     n_points, n_samples, n_dim = TEST_CASE_SETTINGS["100k"]
     pc = create_sample_data(n_points, n_dim)
     benchmark(fpsample.bucket_fps_kdline_sampling, pc, n_samples, 9)
+
+
+@pytest.mark.benchmark(**TEST_BENCHMARK_SETTINGS["100k"])
+def test_bucket_fps_kdtree_100k_flat(benchmark):
+    n_points, n_samples, n_dim = TEST_CASE_SETTINGS["100k"]
+    pc = create_sample_data(n_points, n_dim)
+    res = benchmark(
+        fpsample.bucket_fps_kdtree_sampling, pc, n_samples, start_idx=0, layout="flat"
+    )
+    # the flat layout gives the samples of the pointer one
+    ref = fpsample.bucket_fps_kdtree_sampling(pc, n_samples, start_idx=0, layout="pointer")
+    np.testing.assert_array_equal(res, ref)
+
+
+@pytest.mark.benchmark(**TEST_BENCHMARK_SETTINGS["100k"])
+def test_bucket_fps_kdline_100k_h7_flat(benchmark):
+    n_points, n_samples, n_dim = TEST_CASE_SETTINGS["100k"]
+    pc = create_sample_data(n_points, n_dim)
+    res = benchmark(
+        fpsample.bucket_fps_kdline_sampling, pc, n_samples, 7, start_idx=0, layout="flat"
+    )
+    ref = fpsample.bucket_fps_kdline_sampling(pc, n_samples, 7, start_idx=0, layout="pointer")
+    np.testing.assert_array_equal(res, ref)
+
+
+@pytest.mark.benchmark(**TEST_BENCHMARK_SETTINGS["100k"])
+def test_bucket_fps_kdtree_100k_threads(benchmark):
+    n_points, n_samples, n_dim = TEST_CASE_SETTINGS["100k"]
+    pc = create_sample_data(n_points, n_dim)
+    benchmark(fpsample.bucket_fps_kdtree_sampling, pc, n_samples, num_threads=0)
+
+
+#########################
+#                       #
+#    Concurrent calls   #
+#                       #
+#########################
+CONCURRENT_SAMPLERS = {
+    "vanilla": lambda pc, n: fpsample.fps_sampling(pc, n, start_idx=0),
+    "npdu": lambda pc, n: fpsample.fps_npdu_sampling(pc, n, start_idx=0),
+    "npdu_kdtree": lambda pc, n: fpsample.fps_npdu_kdtree_sampling(pc, n, start_idx=0),
+    "bucket_kdtree": lambda pc, n: fpsample.bucket_fps_kdtree_sampling(pc, n, start_idx=0),
+    "bucket_kdline": lambda pc, n: fpsample.bucket_fps_kdline_sampling(pc, n, 5, start_idx=0),
+}
+
+
+@pytest.mark.benchmark(**TEST_BENCHMARK_SETTINGS["threads"])
+@pytest.mark.parametrize("method", list(CONCURRENT_SAMPLERS))
+def test_concurrent_calls_4k(benchmark, method):
+    # The GIL is released while sampling: calls from several threads must run
+    # side by side and return exactly what the serial calls return.
+    n_points, n_samples, n_dim = TEST_CASE_SETTINGS["4k"]
+    sampler = CONCURRENT_SAMPLERS[method]
+    clouds = [create_sample_data(n_points, n_dim, seed=TEST_SEED + i) for i in range(8)]
+    expected = [sampler(pc, n_samples) for pc in clouds]
+
+    def run():
+        with ThreadPoolExecutor(max_workers=8) as ex:
+            return list(ex.map(lambda pc: sampler(pc, n_samples), clouds * 4))
+
+    results = benchmark(run)
+    for res, exp in zip(results, expected * 4):
+        np.testing.assert_array_equal(res, exp)
+
+
+##############################
+#                            #
+#    Incremental sampling    #
+#                            #
+##############################
+@pytest.mark.parametrize("method", ["fps", "bucket_kdtree"])
+def test_fps_sampler_next_past_end(method):
+    # Asking for more samples than there are points returns the points left,
+    # whatever k is.
+    n_points = 100
+    pc = create_sample_data(n_points)
+    sampler = fpsample.FPSSampler(pc, method, start_idx=0)
+    first = sampler.next(10)
+    rest = sampler.next(10**12)
+    np.testing.assert_array_equal(np.sort(np.concatenate([first, rest])), np.arange(n_points))
+    assert len(sampler.next(10**12)) == 0
+    assert len(sampler) == n_points
+
+
+##########################
+#                        #
+#    Geodesic outputs    #
+#                        #
+##########################
+@pytest.mark.parametrize("return_radii", [False, True])
+@pytest.mark.parametrize("return_dist_min", [False, True])
+def test_geodesic_fps_outputs(return_radii, return_dist_min):
+    # A path of unit edges from 0 to 100: the samples are 0, 100 and 50, and
+    # the geodesic distances are plain path lengths, not squared.
+    n_points, n_samples = 101, 3
+    pc = np.zeros((n_points, 3))
+    pc[:, 0] = np.arange(n_points)
+    neighbours = [[i + d for d in (-1, 1) if 0 <= i + d < n_points] for i in range(n_points)]
+    indptr = np.cumsum([0] + [len(nb) for nb in neighbours]).astype(np.uint64)
+    indices = np.concatenate(neighbours).astype(np.uint32)
+
+    res = fpsample.geodesic_fps_sampling(
+        pc,
+        n_samples,
+        graph=(indptr, indices),
+        start_idx=0,
+        return_radii=return_radii,
+        return_dist_min=return_dist_min,
+    )
+    if not (return_radii or return_dist_min):
+        np.testing.assert_array_equal(res, [0, 100, 50])
+        return
+    assert isinstance(res, tuple)
+    assert len(res) == 1 + return_radii + return_dist_min
+    idx, *outputs = res
+    np.testing.assert_array_equal(idx, [0, 100, 50])
+    if return_radii:
+        np.testing.assert_array_equal(outputs.pop(0), [np.inf, 100, 50])
+    if return_dist_min:
+        expected = np.minimum.reduce([np.abs(np.arange(n_points) - i) for i in (0, 100, 50)])
+        np.testing.assert_array_equal(outputs.pop(0), expected)
+
+
+##########################
+#                        #
+#    Exact KDTree FPS    #
+#                        #
+##########################
+@pytest.mark.parametrize("n_dim", [3, 6])
+@pytest.mark.parametrize("start_idx", [0, 1234, [5, 700, 1999]])
+@pytest.mark.parametrize("radius", [None, 0.2])
+def test_fps_kdtree_matches_fps(n_dim, start_idx, radius):
+    # The KDTree only skips points that the new sample cannot get closer to,
+    # so samples, radii and final distances are those of the vanilla FPS.
+    n_points = 2000
+    pc = create_sample_data(n_points, n_dim)
+    n_samples = n_points if radius is not None else 500
+    kwargs = dict(start_idx=start_idx, radius=radius)
+
+    np.testing.assert_array_equal(
+        fpsample.fps_kdtree_sampling(pc, n_samples, **kwargs),
+        fpsample.fps_sampling(pc, n_samples, **kwargs),
+    )
+    res = fpsample.fps_kdtree_sampling(
+        pc, n_samples, return_radii=True, return_dist_min=True, **kwargs
+    )
+    exp = fpsample.fps_sampling(pc, n_samples, return_radii=True, return_dist_min=True, **kwargs)
+    assert len(res) == len(exp) == 3
+    for r, e in zip(res, exp):
+        np.testing.assert_array_equal(r, e)
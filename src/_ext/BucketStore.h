@@ -0,0 +1,149 @@
+//
+// Column-wise copy of the tree points for the leaf distance updates.
+//
+
+#ifndef KD_TREE_BASED_FARTHEST_POINT_SAMPLING_BUCKETSTORE_H
+#define KD_TREE_BASED_FARTHEST_POINT_SAMPLING_BUCKETSTORE_H
+
+#include "../simd.hpp"
+#include "Point.h"
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <limits>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+namespace quickfps {
+
+// The coordinates of the points of a built tree, one 64-byte aligned column
+// per dimension, and the distance of each point to the sample set, all in
+// tree order so that a bucket is the same range [pointLeft, pointRight) of
+// every column. The distances live only here once the tree is built; the dis
+// field of the tree points goes stale.
+//
+// update() folds samples into a bucket and finds its farthest point, the
+// first one among equal distances as in the leaf loops it replaces. All the
+// samples a bucket has waiting are queued with push_ref() and applied in one
+// pass, each point read once with its distance to every sample taken in
+// registers. For float trees, buckets of 16 points and more go through the
+// SIMD kernels of simd.hpp; smaller ones and other types take the scalar
+// loop, which sums the squared differences in the same order and gives the
+// same distances.
+template <typename T, size_t DIM, typename S> class BucketStore {
+  public:
+    // Copy the coordinates of points[0, n) and set every distance to max.
+    void assign(const Point<T, DIM, S> *points, size_t n) {
+        // columns start on a cache line
+        stride_ = (n + kLane - 1) / kLane * kLane;
+        if (stride_ * DIM > coord_cap_) {
+            coord_cap_ = stride_ * DIM;
+            coords_ = allocate<T>(coord_cap_);
+        }
+        if (stride_ > dis_cap_) {
+            dis_cap_ = stride_;
+            dis_ = allocate<S>(dis_cap_);
+        }
+        size_ = n;
+        for (size_t i = 0; i < n; i++) {
+            for (size_t cur_dim = 0; cur_dim < DIM; cur_dim++)
+                coords_[cur_dim * stride_ + i] = points[i].pos[cur_dim];
+        }
+        reset(0, n);
+    }
+
+    void reset(size_t begin, size_t end) {
+        std::fill(dis_.get() + begin, dis_.get() + end,
+                  std::numeric_limits<S>::max());
+    }
+
+    size_t size() const { return size_; }
+
+    S dis(size_t i) const { return dis_[i]; }
+
+    // Make room for `n` queued samples, so that push_ref() never allocates.
+    void reserve_refs(size_t n) { refs_.reserve(n * DIM); }
+
+    // Queue the sample at `ref` for the next update(begin, end, max_idx).
+    void push_ref(const T *ref) {
+        assert(refs_.size() + DIM <= refs_.capacity());
+        refs_.insert(refs_.end(), ref, ref + DIM);
+    }
+
+    // dis[i] = min(dis[i], |point i - ref|^2) over [begin, end), which must
+    // not be empty, for every queued sample `ref`, then clear the queue.
+    // Returns the largest distance of the range and its position in max_idx.
+    S update(size_t begin, size_t end, size_t &max_idx) {
+        S maxdis = update(begin, end, refs_.data(), refs_.size() / DIM,
+                          max_idx);
+        refs_.clear();
+        return maxdis;
+    }
+
+  private:
+    static constexpr size_t kLane = 64 / sizeof(float);
+
+    // `refs` holds n_refs samples of DIM coordinates each.
+    S update(size_t begin, size_t end, const T *refs, size_t n_refs,
+             size_t &max_idx) {
+        if constexpr (std::is_same<T, float>::value &&
+                      std::is_same<S, float>::value) {
+            if (end - begin >= kLane) {
+                simd::CloudView view{coords_.get(), size_, DIM, stride_,
+                                     simd::Layout::SoA};
+                simd::ArgMax best =
+                    n_refs == 1 ? simd::update_argmax_first(
+                                      view, begin, end, refs, dis_.get())
+                                : simd::update_min_argmax(view, begin, end,
+                                                          refs, n_refs,
+                                                          dis_.get());
+                max_idx = best.idx;
+                return best.val;
+            }
+        }
+        S maxdis = std::numeric_limits<S>::lowest();
+        for (size_t i = begin; i < end; i++) {
+            S dis = dis_[i];
+            for (size_t r = 0; r < n_refs; r++) {
+                const T *ref = refs + r * DIM;
+                S ref_dis(0);
+                for (size_t cur_dim = 0; cur_dim < DIM; cur_dim++) {
+                    T d = coords_[cur_dim * stride_ + i] - ref[cur_dim];
+                    ref_dis += d * d;
+                }
+                dis = std::min(dis, ref_dis);
+            }
+            dis_[i] = dis;
+            if (dis > maxdis) {
+                maxdis = dis;
+                max_idx = i;
+            }
+        }
+        return maxdis;
+    }
+
+    struct AlignedDelete {
+        void operator()(void *p) const {
+            ::operator delete(p, std::align_val_t(64));
+        }
+    };
+    template <typename U> using Buffer = std::unique_ptr<U[], AlignedDelete>;
+
+    template <typename U> static Buffer<U> allocate(size_t n) {
+        static_assert(std::is_trivial<U>::value, "columns hold plain numbers");
+        return Buffer<U>(static_cast<U *>(
+            ::operator new(n * sizeof(U), std::align_val_t(64))));
+    }
+
+    Buffer<T> coords_;
+    Buffer<S> dis_;
+    std::vector<T> refs_;
+    size_t size_ = 0, stride_ = 0;
+    size_t coord_cap_ = 0, dis_cap_ = 0;
+};
+
+} // namespace quickfps
+
+#endif // KD_TREE_BASED_FARTHEST_POINT_SAMPLING_BUCKETSTORE_H
@@ -0,0 +1,90 @@
+//
+// Shared storage for the delayed-update queues of the KD tree nodes.
+//
+
+#ifndef KD_TREE_BASED_FARTHEST_POINT_SAMPLING_DELAYPOOL_H
+#define KD_TREE_BASED_FARTHEST_POINT_SAMPLING_DELAYPOOL_H
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace quickfps {
+
+// Queues of sample indices, one per node, carved out of a single pool of
+// small blocks. A queue holds at most kCapacity samples, in one block that it
+// takes on its first push and hands back when cleared. A node whose queue is
+// full pushes its samples down the tree instead of queueing one more, so
+// reset() can make room for every queue at once and the pool never has to
+// grow while sampling.
+//
+// Blocks are addressed by index, so a queue may be walked with for_each()
+// while other queues grow.
+class DelayPool {
+  public:
+    static constexpr uint32_t kNil = UINT32_MAX;
+    static constexpr size_t kCapacity = 3;
+
+    struct List {
+        uint32_t block = kNil;
+        uint32_t size = 0;
+
+        bool empty() const { return size == 0; }
+        bool full() const { return size == kCapacity; }
+    };
+
+    // Drop every queue and make room for `n_lists` of them. Lists from
+    // before must be reset to List{} by their owners.
+    void reset(size_t n_lists) {
+        n_lists = std::max<size_t>(n_lists, 1);
+        if (n_lists > blocks_.size())
+            blocks_.resize(n_lists);
+        for (size_t b = 0; b + 1 < blocks_.size(); b++)
+            blocks_[b].next = static_cast<uint32_t>(b + 1);
+        blocks_.back().next = kNil;
+        free_ = 0;
+    }
+
+    void push(List &list, uint32_t value) {
+        assert(!list.full());
+        if (list.empty())
+            list.block = take_block();
+        blocks_[list.block].items[list.size++] = value;
+    }
+
+    template <typename F> void for_each(const List &list, F &&f) {
+        for (uint32_t k = 0; k < list.size; k++)
+            f(blocks_[list.block].items[k]);
+    }
+
+    void clear(List &list) {
+        if (list.empty())
+            return;
+        blocks_[list.block].next = free_;
+        free_ = list.block;
+        list = List{};
+    }
+
+  private:
+    struct Block {
+        uint32_t items[kCapacity];
+        uint32_t next;
+    };
+
+    uint32_t take_block() {
+        // one block per list, set aside by reset()
+        assert(free_ != kNil);
+        uint32_t b = free_;
+        free_ = blocks_[b].next;
+        return b;
+    }
+
+    std::vector<Block> blocks_;
+    uint32_t free_ = kNil;
+};
+
+} // namespace quickfps
+
+#endif // KD_TREE_BASED_FARTHEST_POINT_SAMPLING_DELAYPOOL_H
@@ -0,0 +1,88 @@
+//
+// Flattened counterpart of KDLineTree.
+//
+
+#ifndef FPS_CPU_FLATKDLINETREE_H
+#define FPS_CPU_FLATKDLINETREE_H
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+#include "FlatKDTreeBase.h"
+
+namespace quickfps {
+
+template <typename T, size_t DIM, typename S = T>
+class FlatKDLineTree
+    : public FlatKDTreeBase<FlatKDLineTree<T, DIM, S>, T, DIM, S> {
+    using Base = FlatKDTreeBase<FlatKDLineTree<T, DIM, S>, T, DIM, S>;
+    friend Base;
+
+  public:
+    using typename Base::_Point;
+    using typename Base::_Points;
+
+    FlatKDLineTree(_Points data, size_t pointSize, size_t treeHigh,
+                   _Points samplePoints)
+        : Base(data, pointSize, samplePoints), high_(treeHigh) {}
+
+    void buildKDtree(size_t n_threads = 1);
+
+  protected:
+    size_t high_;
+    // Leaves in the order KDLineTree lists its buckets, left to right
+    std::vector<uint32_t> buckets_;
+
+    size_t max_index() const;
+
+    void update_distance(uint32_t ref) {
+        for (uint32_t bucket : buckets_)
+            this->update_node(bucket, ref);
+    }
+
+    bool leftNode(size_t high, size_t count) const {
+        return high == this->high_ || count == 1;
+    }
+
+    size_t nodeCapacity() const {
+        size_t bound = Base::nodeCapacity();
+        if (high_ + 1 < 8 * sizeof(size_t))
+            bound = std::min(bound, (size_t(1) << (high_ + 1)) - 1);
+        return bound;
+    }
+};
+
+template <typename T, size_t DIM, typename S>
+void FlatKDLineTree<T, DIM, S>::buildKDtree(size_t n_threads) {
+    Base::buildKDtree(n_threads);
+    buckets_.clear();
+    std::vector<uint32_t> stack(1, 0);
+    while (!stack.empty()) {
+        uint32_t n = stack.back();
+        stack.pop_back();
+        if (this->nodes_[n].is_leaf()) {
+            buckets_.push_back(n);
+        } else {
+            stack.push_back(this->nodes_[n].left + 1);
+            stack.push_back(this->nodes_[n].left);
+        }
+    }
+}
+
+template <typename T, size_t DIM, typename S>
+size_t FlatKDLineTree<T, DIM, S>::max_index() const {
+    size_t idx = 0;
+    S max_distance = std::numeric_limits<S>::lowest();
+    for (uint32_t bucket : buckets_) {
+        if (this->nodes_[bucket].max_dis > max_distance) {
+            max_distance = this->nodes_[bucket].max_dis;
+            idx = this->nodes_[bucket].max_idx;
+        }
+    }
+    return idx;
+}
+
+} // namespace quickfps
+
+#endif // FPS_CPU_FLATKDLINETREE_H
@@ -0,0 +1,34 @@
+//
+// Flattened counterpart of KDTree.
+//
+
+#ifndef FPS_CPU_FLATKDTREE_H
+#define FPS_CPU_FLATKDTREE_H
+
+#include "FlatKDTreeBase.h"
+
+namespace quickfps {
+
+template <typename T, size_t DIM, typename S = T>
+class FlatKDTree : public FlatKDTreeBase<FlatKDTree<T, DIM, S>, T, DIM, S> {
+    using Base = FlatKDTreeBase<FlatKDTree<T, DIM, S>, T, DIM, S>;
+    friend Base;
+
+  public:
+    using typename Base::_Point;
+    using typename Base::_Points;
+
+    FlatKDTree(_Points data, size_t pointSize, _Points samplePoints)
+        : Base(data, pointSize, samplePoints) {}
+
+  protected:
+    size_t max_index() const { return this->nodes_[0].max_idx; }
+
+    void update_distance(uint32_t ref) { this->update_node(0, ref); }
+
+    bool leftNode(size_t, size_t count) const { return count == 1; }
+};
+
+} // namespace quickfps
+
+#endif // FPS_CPU_FLATKDTREE_H
@@ -0,0 +1,324 @@
+//
+// Flattened counterpart of KDTreeBase.
+//
+
+#ifndef KD_TREE_BASED_FARTHEST_POINT_SAMPLING_FLATKDTREEBASE_H
+#define KD_TREE_BASED_FARTHEST_POINT_SAMPLING_FLATKDTREEBASE_H
+
+#include "BucketStore.h"
+#include "DelayPool.h"
+#include "KDSplit.h"
+#include "Point.h"
+#include "../thread_pool.hpp"
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <vector>
+
+namespace quickfps {
+
+// The bucket FPS of KDTreeBase over a pointer-free tree. Nodes live in one
+// array in breadth-first order, the two children of a node side by side, and
+// link to each other by 32-bit index. A node keeps the distance and position
+// of its farthest point instead of a copy of it, next to its bounding box, so
+// that the test deciding whether an update goes down the subtree reads one
+// cache line for DIM <= 5. The tree variants plug in through CRTP: Derived
+// provides leftNode(high, count), max_index() and update_distance(ref), and
+// may shadow nodeCapacity().
+//
+// Samples and results are those of the matching KDTreeBase engine, and the
+// delayed updates and the distances go to the same kind of DelayPool and
+// BucketStore. Trees are limited to 2^31 points.
+template <typename Derived, typename T, size_t DIM, typename S>
+class FlatKDTreeBase {
+  public:
+    using _Point = Point<T, DIM, S>;
+    using _Points = _Point *;
+
+    struct alignas(64) Node {
+        S max_dis;
+        uint32_t max_idx;  // position in points_ of the farthest point
+        uint32_t left;     // the right child is left + 1, leaves have 0
+        uint32_t pointLeft, pointRight;
+        T low[DIM];
+        T high[DIM];
+
+        bool is_leaf() const { return left == 0; }
+    };
+
+    size_t pointSize;
+    _Points sample_points;
+    _Points points_;
+
+    FlatKDTreeBase(_Points data, size_t pointSize, _Points samplePoints)
+        : pointSize(pointSize), sample_points(samplePoints), points_(data) {}
+
+    // With n_threads > 1 the nodes of each level are split on a worker
+    // pool; the tree is the same for any n_threads.
+    void buildKDtree(size_t n_threads = 1);
+
+    void init(const _Point &ref) { this->init(&ref, 1); }
+
+    void init(const _Point *refs, size_t n_refs);
+
+    void flush(S *dist_out);
+
+    // Same contract as KDTreeBase::sample().
+    size_t sample(size_t sample_num, S stop_dis = 0, size_t first = 1);
+
+  protected:
+    std::vector<Node> nodes_;
+    // Samples waiting to be pushed below each node
+    std::vector<DelayPool::List> delays_;
+    DelayPool pool_;
+    BucketStore<T, DIM, S> store_;
+
+    size_t nodeCapacity() const {
+        return pointSize == 0 ? 1 : 2 * pointSize - 1;
+    }
+
+    // Fold sample `ref` into the subtree of node n, or delay it there.
+    void update_node(uint32_t n, uint32_t ref);
+
+    // Fold the samples queued in store_ into leaf `node`.
+    void update_leaf(Node &node) {
+        size_t max_idx = node.pointLeft;
+        node.max_dis = store_.update(node.pointLeft, node.pointRight, max_idx);
+        node.max_idx = static_cast<uint32_t>(max_idx);
+    }
+
+    void update_max(Node &node) {
+        const Node &l = nodes_[node.left], &r = nodes_[node.left + 1];
+        const Node &winner = l.max_dis > r.max_dis ? l : r;
+        node.max_dis = winner.max_dis;
+        node.max_idx = winner.max_idx;
+    }
+
+    static S distance(const T *a, const T *b) {
+        S dis(0);
+        for (size_t cur_dim = 0; cur_dim < DIM; cur_dim++) {
+            T d = a[cur_dim] - b[cur_dim];
+            dis += d * d;
+        }
+        return dis;
+    }
+
+    static S bound_distance(const Node &node, const T *ref) {
+        S bound_dis(0);
+        for (size_t cur_dim = 0; cur_dim < DIM; cur_dim++) {
+            S dim_distance = 0;
+            if (ref[cur_dim] > node.high[cur_dim])
+                dim_distance = ref[cur_dim] - node.high[cur_dim];
+            else if (ref[cur_dim] < node.low[cur_dim])
+                dim_distance = node.low[cur_dim] - ref[cur_dim];
+            bound_dis += dim_distance * dim_distance;
+        }
+        return bound_dis;
+    }
+
+  private:
+    Derived &derived() { return static_cast<Derived &>(*this); }
+};
+
+// Breadth-first, one level at a time: the nodes of a level are split
+// independently, then their children are appended after the level in order,
+// left before right.
+template <typename Derived, typename T, size_t DIM, typename S>
+void FlatKDTreeBase<Derived, T, DIM, S>::buildKDtree(size_t n_threads) {
+    nodes_.clear();
+    nodes_.reserve(derived().nodeCapacity());
+    auto add_node = [this](size_t left, size_t right,
+                           const std::array<Interval<T>, DIM> &bboxs) {
+        Node node{};
+        node.pointLeft = static_cast<uint32_t>(left);
+        node.pointRight = static_cast<uint32_t>(right);
+        for (size_t cur_dim = 0; cur_dim < DIM; cur_dim++) {
+            node.low[cur_dim] = bboxs[cur_dim].low;
+            node.high[cur_dim] = bboxs[cur_dim].high;
+        }
+        nodes_.push_back(node);
+    };
+
+    // split_delta 0 marks a leaf
+    struct Split {
+        size_t split_delta;
+        std::array<Interval<T>, DIM> left_bboxs, right_bboxs;
+    };
+    std::vector<Split> splits;
+    auto split_nodes = [&](size_t first, size_t last, size_t level_begin,
+                           size_t high) {
+        for (size_t n = first; n < last; n++) {
+            Split &split = splits[n - level_begin];
+            const size_t left = nodes_[n].pointLeft,
+                         right = nodes_[n].pointRight;
+            split.split_delta = 0;
+            if (derived().leftNode(high, right - left))
+                continue;
+
+            std::array<Interval<T>, DIM> bboxs;
+            for (size_t cur_dim = 0; cur_dim < DIM; cur_dim++) {
+                bboxs[cur_dim].low = nodes_[n].low[cur_dim];
+                bboxs[cur_dim].high = nodes_[n].high[cur_dim];
+            }
+            size_t split_dim = findSplitDim(bboxs);
+            T split_val = qSelectMedian(points_, split_dim, left, right);
+            split.split_delta =
+                planeSplit(points_, left, right, split_dim, split_val,
+                           split.left_bboxs, split.right_bboxs);
+        }
+    };
+
+    std::unique_ptr<threading::WorkerPool> pool;
+    if (n_threads > 1)
+        pool.reset(new threading::WorkerPool(n_threads));
+
+    add_node(0, pointSize, computeBoundingBox(points_, 0, pointSize));
+    for (size_t level_begin = 0, high = 0; level_begin < nodes_.size();
+         high++) {
+        const size_t level_end = nodes_.size();
+        const size_t level_size = level_end - level_begin;
+        splits.resize(level_size);
+        if (pool && level_size > 1) {
+            pool->run([&](size_t tid) {
+                auto range =
+                    threading::split_range(level_size, pool->size(), tid);
+                split_nodes(level_begin + range.first,
+                            level_begin + range.second, level_begin, high);
+            });
+        } else {
+            split_nodes(level_begin, level_end, level_begin, high);
+        }
+
+        for (size_t n = level_begin; n < level_end; n++) {
+            const Split &split = splits[n - level_begin];
+            if (split.split_delta == 0)
+                continue;
+            const size_t left = nodes_[n].pointLeft,
+                         right = nodes_[n].pointRight;
+            nodes_[n].left = static_cast<uint32_t>(nodes_.size());
+            add_node(left, left + split.split_delta, split.left_bboxs);
+            add_node(left + split.split_delta, right, split.right_bboxs);
+        }
+        level_begin = level_end;
+    }
+    delays_.assign(nodes_.size(), DelayPool::List{});
+    store_.assign(points_, pointSize);
+}
+
+// Children come after their parent, so one backward sweep settles the
+// leaves before the nodes above them.
+template <typename Derived, typename T, size_t DIM, typename S>
+void FlatKDTreeBase<Derived, T, DIM, S>::init(const _Point *refs,
+                                              size_t n_refs) {
+    for (size_t i = 0; i < n_refs; i++) {
+        this->sample_points[i] = refs[i];
+        this->sample_points[i].reset();
+        for (size_t j = 0; j < i; j++)
+            this->sample_points[i].updatedistance(refs[j]);
+    }
+    pool_.reset(nodes_.size());
+    // a leaf applies its full queue and one more sample at a time
+    store_.reserve_refs(std::max(n_refs, DelayPool::kCapacity + 1));
+    for (size_t n = nodes_.size(); n-- > 0;) {
+        Node &node = nodes_[n];
+        delays_[n] = DelayPool::List{};
+        if (!node.is_leaf()) {
+            update_max(node);
+            continue;
+        }
+        for (size_t r = 0; r < n_refs; r++)
+            store_.push_ref(refs[r].pos);
+        update_leaf(node);
+    }
+}
+
+// Same steps as KDNode::update_distance.
+template <typename Derived, typename T, size_t DIM, typename S>
+void FlatKDTreeBase<Derived, T, DIM, S>::update_node(uint32_t n,
+                                                     uint32_t ref) {
+    Node &node = nodes_[n];
+    const T *ref_pos = sample_points[ref].pos;
+    const S lastmax_distance = node.max_dis;
+    DelayPool::List &delay = delays_[n];
+    if (distance(points_[node.max_idx].pos, ref_pos) > lastmax_distance) {
+        // the farthest point stays, the others may still get closer
+        if (bound_distance(node, ref_pos) >= lastmax_distance)
+            return;
+        if (!delay.full()) {
+            pool_.push(delay, ref);
+            return;
+        }
+        // the queue is full: hand it down together with `ref`
+    }
+
+    if (!node.is_leaf()) {
+        for (uint32_t child = node.left; child <= node.left + 1; child++) {
+            pool_.for_each(delay, [&](uint32_t delay_ref) {
+                update_node(child, delay_ref);
+            });
+            update_node(child, ref);
+        }
+        pool_.clear(delay);
+        update_max(node);
+    } else {
+        pool_.for_each(delay, [&](uint32_t delay_ref) {
+            store_.push_ref(sample_points[delay_ref].pos);
+        });
+        store_.push_ref(ref_pos);
+        update_leaf(node);
+        pool_.clear(delay);
+    }
+}
+
+template <typename Derived, typename T, size_t DIM, typename S>
+size_t FlatKDTreeBase<Derived, T, DIM, S>::sample(size_t sample_num,
+                                                  S stop_dis, size_t first) {
+    for (size_t i = first; i < sample_num; i++) {
+        size_t max_idx = derived().max_index();
+        S max_dis = store_.dis(max_idx);
+        if (max_dis < stop_dis)
+            return i;
+        this->sample_points[i] = points_[max_idx];
+        this->sample_points[i].dis = max_dis;
+        derived().update_distance(static_cast<uint32_t>(i));
+    }
+    return sample_num;
+}
+
+// Push every delayed sample down to the leaves, top-down, and apply it. The
+// samples go through update_node(), which keeps the queues below within
+// capacity.
+template <typename Derived, typename T, size_t DIM, typename S>
+void FlatKDTreeBase<Derived, T, DIM, S>::flush(S *dist_out) {
+    for (size_t n = 0; n < nodes_.size(); n++) {
+        Node &node = nodes_[n];
+        DelayPool::List &delay = delays_[n];
+        if (delay.empty())
+            continue;
+        if (!node.is_leaf()) {
+            for (uint32_t child = node.left; child <= node.left + 1; child++) {
+                pool_.for_each(delay, [&](uint32_t delay_ref) {
+                    update_node(child, delay_ref);
+                });
+            }
+        } else {
+            pool_.for_each(delay, [&](uint32_t delay_ref) {
+                store_.push_ref(sample_points[delay_ref].pos);
+            });
+            update_leaf(node);
+        }
+        pool_.clear(delay);
+    }
+    for (size_t n = nodes_.size(); n-- > 0;) {
+        if (!nodes_[n].is_leaf())
+            update_max(nodes_[n]);
+    }
+    for (size_t i = 0; i < pointSize; i++)
+        dist_out[points_[i].id] = store_.dis(i);
+}
+
+} // namespace quickfps
+
+#endif // KD_TREE_BASED_FARTHEST_POINT_SAMPLING_FLATKDTREEBASE_H
@@ -6,6 +6,7 @@
 #ifndef FPS_CPU_KDLINETREE_H
 #define FPS_CPU_KDLINETREE_H
 
+#include <algorithm>
 #include <limits>
 #include <vector>
 
@@ -28,17 +29,28 @@ class KDLineTree : public KDTreeBase<T, DIM, S> {
 
     size_t high_;
 
-    _Point max_point() override;
+    size_t max_index() const override;
 
-    void update_distance(const _Point &ref_point) override;
+    void update_distance(uint32_t ref) override;
 
-    void sample(size_t sample_num) override;
+    size_t sample(size_t sample_num, S stop_dis = 0,
+                  size_t first = 1) override;
 
     bool leftNode(size_t high, size_t count) const override {
         return high == this->high_ || count == 1;
     };
 
     void addNode(NodePtr p) override;
+
+  protected:
+    // Leaves sit at depth high_ at the latest.
+    size_t nodeCapacity(size_t count, size_t high) const override {
+        size_t bound = KDTreeBase<T, DIM, S>::nodeCapacity(count, high);
+        size_t levels = high_ - std::min(high, high_) + 1;
+        if (levels < 8 * sizeof(size_t))
+            bound = std::min(bound, (size_t(1) << levels) - 1);
+        return bound;
+    }
 };
 
 template <typename T, size_t DIM, typename S>
@@ -54,34 +66,38 @@ KDLineTree<T, DIM, S>::~KDLineTree() {
 }
 
 template <typename T, size_t DIM, typename S>
-typename KDLineTree<T, DIM, S>::_Point KDLineTree<T, DIM, S>::max_point() {
-    _Point tmpPoint;
+size_t KDLineTree<T, DIM, S>::max_index() const {
+    size_t max_idx = 0;
     S max_distance = std::numeric_limits<S>::lowest();
     for (const auto &bucket : KDNode_list) {
-        if (bucket->max_point.dis > max_distance) {
-            max_distance = bucket->max_point.dis;
-            tmpPoint = bucket->max_point;
+        if (bucket->max_dis > max_distance) {
+            max_distance = bucket->max_dis;
+            max_idx = bucket->max_idx;
         }
     }
-    return tmpPoint;
+    return max_idx;
 }
 
 template <typename T, size_t DIM, typename S>
-void KDLineTree<T, DIM, S>::update_distance(const _Point &ref_point) {
-    for (const auto &bucket : KDNode_list) {
-        bucket->send_delay_point(ref_point);
-        bucket->update_distance();
-    }
+void KDLineTree<T, DIM, S>::update_distance(uint32_t ref) {
+    for (const auto &bucket : KDNode_list)
+        bucket->update_distance(ref, this->delays_, this->store_,
+                                this->sample_points);
 }
 
 template <typename T, size_t DIM, typename S>
-void KDLineTree<T, DIM, S>::sample(size_t sample_num) {
-    _Point ref_point;
-    for (size_t i = 1; i < sample_num; i++) {
-        ref_point = this->max_point();
-        this->sample_points[i] = ref_point;
-        this->update_distance(ref_point);
+size_t KDLineTree<T, DIM, S>::sample(size_t sample_num, S stop_dis,
+                                size_t first) {
+    for (size_t i = first; i < sample_num; i++) {
+        size_t max_idx = this->max_index();
+        S max_dis = this->store_.dis(max_idx);
+        if (max_dis < stop_dis)
+            return i;
+        this->sample_points[i] = this->points_[max_idx];
+        this->sample_points[i].dis = max_dis;
+        this->update_distance(static_cast<uint32_t>(i));
     }
+    return sample_num;
 }
 
 template <typename T, size_t DIM, typename S>
@@ -6,10 +6,11 @@
 #ifndef KD_TREE_BASED_FARTHEST_POINT_SAMPLING_KDNODE_H
 #define KD_TREE_BASED_FARTHEST_POINT_SAMPLING_KDNODE_H
 #include <array>
+#include <cstdint>
 #include <limits>
-#include <queue>
-#include <vector>
 
+#include "BucketStore.h"
+#include "DelayPool.h"
 #include "Interval.h"
 #include "Point.h"
 
@@ -19,86 +20,78 @@ template <typename T, size_t DIM, typename S> class KDNode {
   public:
     using _Point = Point<T, DIM, S>;
     using _Points = _Point *;
+    using _Store = BucketStore<T, DIM, S>;
     _Points points;
     size_t pointLeft, pointRight;
     size_t idx;
 
     std::array<Interval<T>, DIM> bboxs;
-    std::vector<_Point> waitpoints;
-    std::vector<_Point> delaypoints;
-    _Point max_point;
+    // Samples not yet applied below this node, as indices into the sample
+    // array of the tree
+    DelayPool::List delaypoints;
+    // The farthest point of the subtree, by position in `points`
+    S max_dis;
+    size_t max_idx;
     KDNode *left;
     KDNode *right;
 
     KDNode();
 
-    KDNode(const KDNode &a);
+    KDNode(const KDNode &a) = delete;
 
     KDNode(const std::array<Interval<T>, DIM> &bboxs);
 
-    void init(const _Point &ref);
+    void init(const _Point *refs, size_t n_refs, _Store &store);
 
-    void updateMaxPoint(const _Point &lpoint, const _Point &rpoint) {
-        if (lpoint.dis > rpoint.dis)
-            this->max_point = lpoint;
-        else
-            this->max_point = rpoint;
+    void updateMaxPoint() {
+        const KDNode *winner =
+            this->left->max_dis > this->right->max_dis ? this->left
+                                                       : this->right;
+        this->max_dis = winner->max_dis;
+        this->max_idx = winner->max_idx;
     }
 
     S bound_distance(const _Point &ref_point) const;
 
-    void send_delay_point(const _Point &point) {
-        this->waitpoints.push_back(point);
-    }
+    // Fold sample `ref` into this subtree, or delay it here. The distances
+    // of the points are those of `store`.
+    void update_distance(uint32_t ref, DelayPool &pool, _Store &store,
+                         const _Point *samples);
 
-    void update_distance();
+    void flush(DelayPool &pool, _Store &store, const _Point *samples);
 
-    void reset();
+    void reset(DelayPool &pool, _Store &store);
 
     size_t size() const;
 };
 
 template <typename T, size_t DIM, typename S>
 KDNode<T, DIM, S>::KDNode()
-    : points(nullptr), pointLeft(0), pointRight(0), left(nullptr),
+    : points(nullptr), pointLeft(0), pointRight(0),
+      max_dis(std::numeric_limits<S>::max()), max_idx(0), left(nullptr),
       right(nullptr) {}
 
 template <typename T, size_t DIM, typename S>
 KDNode<T, DIM, S>::KDNode(const std::array<Interval<T>, DIM> &other_bboxs)
-    : points(nullptr), pointLeft(0), pointRight(0), left(nullptr),
+    : points(nullptr), pointLeft(0), pointRight(0),
+      max_dis(std::numeric_limits<S>::max()), max_idx(0), left(nullptr),
       right(nullptr) {
     std::copy(other_bboxs.cbegin(), other_bboxs.cend(), this->bboxs.begin());
 }
 
 template <typename T, size_t DIM, typename S>
-KDNode<T, DIM, S>::KDNode(const KDNode &a)
-    : points(a.points), pointLeft(a.pointLeft), pointRight(a.pointRight),
-      left(a.left), right(a.right), idx(a.idx) {
-    std::copy(a.bboxs.cbegin(), a.bboxs.cend(), this->bboxs.begin());
-    std::copy(a.waitpoints.cbegin(), a.waitpoints.cend(),
-              this->waitpoints.begin());
-    std::copy(a.delaypoints.cbegin(), a.delaypoints.cend(),
-              this->delaypoints.begin());
-}
-
-template <typename T, size_t DIM, typename S>
-void KDNode<T, DIM, S>::init(const _Point &ref) {
-    waitpoints.clear();
-    delaypoints.clear();
+void KDNode<T, DIM, S>::init(const _Point *refs, size_t n_refs,
+                             _Store &store) {
+    // the tree has just reset the pool
+    delaypoints = DelayPool::List{};
     if (this->left && this->right) {
-        this->left->init(ref);
-        this->right->init(ref);
-        updateMaxPoint(this->left->max_point, this->right->max_point);
+        this->left->init(refs, n_refs, store);
+        this->right->init(refs, n_refs, store);
+        updateMaxPoint();
     } else {
-        S dis;
-        S maxdis = std::numeric_limits<S>::lowest();
-        for (size_t i = pointLeft; i < pointRight; i++) {
-            dis = points[i].updatedistance(ref);
-            if (dis > maxdis) {
-                maxdis = dis;
-                max_point = points[i];
-            }
-        }
+        for (size_t r = 0; r < n_refs; r++)
+            store.push_ref(refs[r].pos);
+        max_dis = store.update(pointLeft, pointRight, max_idx);
     }
 }
 
@@ -112,69 +105,85 @@ S KDNode<T, DIM, S>::bound_distance(const _Point &ref_point) const {
             dim_distance = ref_point[cur_dim] - this->bboxs[cur_dim].high;
         else if (ref_point[cur_dim] < this->bboxs[cur_dim].low)
             dim_distance = this->bboxs[cur_dim].low - ref_point[cur_dim];
-        bound_dis += powi(dim_distance, 2);
+        bound_dis += dim_distance * dim_distance;
     }
     return bound_dis;
 }
 
+// The parent hands its delayed samples down one at a time, followed by the
+// one that reached it, and each is handled as it arrives.
 template <typename T, size_t DIM, typename S>
-void KDNode<T, DIM, S>::update_distance() {
-    for (const auto &ref_point : this->waitpoints) {
-        S lastmax_distance = this->max_point.dis;
-        S cur_distance = this->max_point.distance(ref_point);
-        // cur_distance >
-        // lastmax_distance意味着当前Node的max_point不会进行更新
-        if (cur_distance > lastmax_distance) {
-            S boundary_distance = bound_distance(ref_point);
-            if (boundary_distance < lastmax_distance)
-                this->delaypoints.push_back(ref_point);
-        } else {
-            if (this->right && this->left) {
-                if (!delaypoints.empty()) {
-                    for (const auto &delay_point : delaypoints) {
-                        this->left->send_delay_point(delay_point);
-                        this->right->send_delay_point(delay_point);
-                    }
-                    delaypoints.clear();
-                }
-                this->left->send_delay_point(ref_point);
-                this->left->update_distance();
-
-                this->right->send_delay_point(ref_point);
-                this->right->update_distance();
-
-                updateMaxPoint(this->left->max_point, this->right->max_point);
-            } else {
-                S dis;
-                S maxdis;
-                this->delaypoints.push_back(ref_point);
-                for (const auto &delay_point : delaypoints) {
-                    maxdis = std::numeric_limits<S>::lowest();
-                    for (size_t i = pointLeft; i < pointRight; i++) {
-                        dis = points[i].updatedistance(delay_point);
-                        if (dis > maxdis) {
-                            maxdis = dis;
-                            max_point = points[i];
-                        }
-                    }
-                }
-                this->delaypoints.clear();
-            }
+void KDNode<T, DIM, S>::update_distance(uint32_t ref, DelayPool &pool,
+                                        _Store &store, const _Point *samples) {
+    const _Point &ref_point = samples[ref];
+    S lastmax_distance = this->max_dis;
+    S cur_distance = points[this->max_idx].distance(ref_point);
+    // cur_distance >
+    // lastmax_distance意味着当前Node的max_point不会进行更新
+    if (cur_distance > lastmax_distance) {
+        S boundary_distance = bound_distance(ref_point);
+        if (boundary_distance >= lastmax_distance)
+            return;
+        if (!this->delaypoints.full()) {
+            pool.push(this->delaypoints, ref);
+            return;
         }
+        // the queue is full: hand it down together with `ref`
+    }
+    if (this->right && this->left) {
+        for (KDNode *child : {this->left, this->right}) {
+            pool.for_each(this->delaypoints, [&](uint32_t delay_ref) {
+                child->update_distance(delay_ref, pool, store, samples);
+            });
+            child->update_distance(ref, pool, store, samples);
+        }
+        pool.clear(this->delaypoints);
+
+        updateMaxPoint();
+    } else {
+        // all the waiting samples in one pass over the bucket
+        pool.for_each(this->delaypoints, [&](uint32_t delay_ref) {
+            store.push_ref(samples[delay_ref].pos);
+        });
+        store.push_ref(ref_point.pos);
+        max_dis = store.update(pointLeft, pointRight, max_idx);
+        pool.clear(this->delaypoints);
     }
-    this->waitpoints.clear();
 }
 
-template <typename T, size_t DIM, typename S> void KDNode<T, DIM, S>::reset() {
-    for (size_t i = pointLeft; i < pointRight; i++) {
-        points[i].reset();
+// Push every reference point still delayed in this subtree down to the
+// leaves and apply it, so that each point's dis is exact. The samples go
+// through update_distance(), which keeps the queues below within capacity.
+template <typename T, size_t DIM, typename S>
+void KDNode<T, DIM, S>::flush(DelayPool &pool, _Store &store,
+                              const _Point *samples) {
+    if (this->left && this->right) {
+        for (KDNode *child : {this->left, this->right}) {
+            pool.for_each(this->delaypoints, [&](uint32_t delay_ref) {
+                child->update_distance(delay_ref, pool, store, samples);
+            });
+        }
+        pool.clear(this->delaypoints);
+        this->left->flush(pool, store, samples);
+        this->right->flush(pool, store, samples);
+        updateMaxPoint();
+    } else if (!this->delaypoints.empty()) {
+        pool.for_each(this->delaypoints, [&](uint32_t delay_ref) {
+            store.push_ref(samples[delay_ref].pos);
+        });
+        max_dis = store.update(pointLeft, pointRight, max_idx);
+        pool.clear(this->delaypoints);
     }
-    this->waitpoints.clear();
-    this->delaypoints.clear();
-    this->max_point.reset();
+}
+
+template <typename T, size_t DIM, typename S>
+void KDNode<T, DIM, S>::reset(DelayPool &pool, _Store &store) {
+    store.reset(pointLeft, pointRight);
+    pool.clear(this->delaypoints);
+    this->max_dis = std::numeric_limits<S>::max();
     if (this->left && this->right) {
-        this->left->reset();
-        this->right->reset();
+        this->left->reset(pool, store);
+        this->right->reset(pool, store);
     }
 }
 
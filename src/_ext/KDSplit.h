@@ -0,0 +1,141 @@
+//
+// Created by 韩萌 on 2022/6/14.
+// Refactored by AyajiLin on 2023/9/16.
+//
+
+#ifndef KD_TREE_BASED_FARTHEST_POINT_SAMPLING_KDSPLIT_H
+#define KD_TREE_BASED_FARTHEST_POINT_SAMPLING_KDSPLIT_H
+
+#include "Interval.h"
+#include "Point.h"
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <numeric>
+
+namespace quickfps {
+
+// Split steps shared by the KD tree builders. Each works on the points in
+// [left, right) of the array being partitioned.
+
+template <typename T, size_t DIM, typename S>
+std::array<Interval<T>, DIM>
+computeBoundingBox(const Point<T, DIM, S> *points, size_t left, size_t right) {
+    T min_vals[DIM];
+    T max_vals[DIM];
+    std::fill(min_vals, min_vals + DIM, std::numeric_limits<T>::max());
+    std::fill(max_vals, max_vals + DIM, std::numeric_limits<T>::lowest());
+
+    for (size_t i = left; i < right; ++i) {
+        const Point<T, DIM, S> &pos = points[i];
+
+        for (size_t cur_dim = 0; cur_dim < DIM; cur_dim++) {
+            T val = pos[cur_dim];
+            min_vals[cur_dim] = std::min(min_vals[cur_dim], val);
+            max_vals[cur_dim] = std::max(max_vals[cur_dim], val);
+        }
+    }
+
+    std::array<Interval<T>, DIM> bboxs;
+
+    for (size_t cur_dim = 0; cur_dim < DIM; cur_dim++) {
+        bboxs[cur_dim].low = min_vals[cur_dim];
+        bboxs[cur_dim].high = max_vals[cur_dim];
+    }
+
+    return bboxs;
+}
+
+template <typename T, size_t DIM>
+size_t findSplitDim(const std::array<Interval<T>, DIM> &bboxs) {
+    T min_, max_;
+    T span = 0;
+    size_t best_dim = 0;
+
+    for (size_t cur_dim = 0; cur_dim < DIM; cur_dim++) {
+        min_ = bboxs[cur_dim].low;
+        max_ = bboxs[cur_dim].high;
+        T cur_span = (max_ - min_);
+
+        if (cur_span > span) {
+            best_dim = cur_dim;
+            span = cur_span;
+        }
+    }
+
+    return best_dim;
+}
+
+template <typename T, size_t DIM, typename S>
+T qSelectMedian(const Point<T, DIM, S> *points, size_t dim, size_t left,
+                size_t right) {
+    T sum = std::accumulate(points + left, points + right, 0.0,
+                            [dim](const T &acc, const Point<T, DIM, S> &point) {
+                                return acc + point.pos[dim];
+                            });
+    return sum / (right - left);
+}
+
+// Move the points below split_val to the front and return how many went
+// there, clamped to [1, right - left - 1] so that neither side is empty. The
+// bounding boxes of the two sides are collected on the way, which saves the
+// two computeBoundingBox scans a split would otherwise need afterwards.
+template <typename T, size_t DIM, typename S>
+size_t planeSplit(Point<T, DIM, S> *points, ssize_t left, ssize_t right,
+                  size_t split_dim, T split_val,
+                  std::array<Interval<T>, DIM> &left_bboxs,
+                  std::array<Interval<T>, DIM> &right_bboxs) {
+    T low[2][DIM], high[2][DIM];
+    for (size_t side = 0; side < 2; side++) {
+        std::fill(low[side], low[side] + DIM, std::numeric_limits<T>::max());
+        std::fill(high[side], high[side] + DIM,
+                  std::numeric_limits<T>::lowest());
+    }
+    auto grow = [&](size_t side, const Point<T, DIM, S> &point) {
+        for (size_t cur_dim = 0; cur_dim < DIM; cur_dim++) {
+            low[side][cur_dim] = std::min(low[side][cur_dim], point[cur_dim]);
+            high[side][cur_dim] = std::max(high[side][cur_dim], point[cur_dim]);
+        }
+    };
+
+    ssize_t start = left;
+    ssize_t end = right - 1;
+
+    for (;;) {
+        while (start <= end && points[start].pos[split_dim] < split_val)
+            grow(0, points[start++]);
+        while (start <= end && points[end].pos[split_dim] >= split_val)
+            grow(1, points[end--]);
+
+        if (start > end)
+            break;
+        std::swap(points[start], points[end]);
+        grow(0, points[start++]);
+        grow(1, points[end--]);
+    }
+
+    ssize_t lim1 = start - left;
+    if (start == left)
+        lim1 = 1;
+    if (start == right)
+        lim1 = (right - left - 1);
+
+    if (lim1 != start - left) {
+        // clamped: the sides are not the ones the scan saw
+        left_bboxs = computeBoundingBox(points, left, left + lim1);
+        right_bboxs = computeBoundingBox(points, left + lim1, right);
+    } else {
+        for (size_t cur_dim = 0; cur_dim < DIM; cur_dim++) {
+            left_bboxs[cur_dim].low = low[0][cur_dim];
+            left_bboxs[cur_dim].high = high[0][cur_dim];
+            right_bboxs[cur_dim].low = low[1][cur_dim];
+            right_bboxs[cur_dim].high = high[1][cur_dim];
+        }
+    }
+
+    return static_cast<ssize_t>(lim1);
+}
+
+} // namespace quickfps
+
+#endif // KD_TREE_BASED_FARTHEST_POINT_SAMPLING_KDSPLIT_H
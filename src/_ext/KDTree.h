@@ -18,11 +18,12 @@ class KDTree : public KDTreeBase<T, DIM, S> {
     using typename KDTreeBase<T, DIM, S>::NodePtr;
     explicit KDTree(_Points data, size_t pointSize, _Points samplePoints);
 
-    _Point max_point() override { return this->root_->max_point; };
+    size_t max_index() const override { return this->root_->max_idx; };
 
-    void update_distance(const _Point &ref_point) override;
+    void update_distance(uint32_t ref) override;
 
-    void sample(size_t sample_num) override;
+    size_t sample(size_t sample_num, S stop_dis = 0,
+                  size_t first = 1) override;
 
     bool leftNode(size_t, size_t count) const override { return count == 1; };
 
@@ -34,19 +35,24 @@ KDTree<T, DIM, S>::KDTree(_Points data, size_t pointSize, _Points samplePoints)
     : KDTreeBase<T, DIM, S>(data, pointSize, samplePoints) {}
 
 template <typename T, size_t DIM, typename S>
-void KDTree<T, DIM, S>::update_distance(const _Point &ref_point) {
-    this->root_->send_delay_point(ref_point);
-    this->root_->update_distance();
+void KDTree<T, DIM, S>::update_distance(uint32_t ref) {
+    this->root_->update_distance(ref, this->delays_, this->store_,
+                                 this->sample_points);
 }
 
 template <typename T, size_t DIM, typename S>
-void KDTree<T, DIM, S>::sample(size_t sample_num) {
-    _Point ref_point;
-    for (size_t i = 1; i < sample_num; i++) {
-        ref_point = this->max_point();
-        this->sample_points[i] = ref_point;
-        this->update_distance(ref_point);
+size_t KDTree<T, DIM, S>::sample(size_t sample_num, S stop_dis,
+                                size_t first) {
+    for (size_t i = first; i < sample_num; i++) {
+        size_t max_idx = this->max_index();
+        S max_dis = this->store_.dis(max_idx);
+        if (max_dis < stop_dis)
+            return i;
+        this->sample_points[i] = this->points_[max_idx];
+        this->sample_points[i].dis = max_dis;
+        this->update_distance(static_cast<uint32_t>(i));
     }
+    return sample_num;
 }
 
 } // namespace quickfps
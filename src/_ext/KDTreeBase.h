@@ -6,11 +6,15 @@
 #ifndef KD_TREE_BASED_FARTHEST_POINT_SAMPLING_KDTREE_H
 #define KD_TREE_BASED_FARTHEST_POINT_SAMPLING_KDTREE_H
 
+#include "BucketStore.h"
 #include "KDNode.h"
+#include "KDSplit.h"
+#include "NodeArena.h"
 #include "Point.h"
+#include "../thread_pool.hpp"
 #include <algorithm>
 #include <array>
-#include <numeric>
+#include <vector>
 
 namespace quickfps {
 
@@ -29,35 +33,68 @@ template <typename T, size_t DIM, typename S> class KDTreeBase {
   public:
     KDTreeBase(_Points data, size_t pointSize, _Points samplePoints);
 
-    ~KDTreeBase();
+    virtual ~KDTreeBase() = default;
 
-    void buildKDtree();
+    // Nodes come from an arena sized by nodeCapacity(), which a rebuild
+    // reuses. The distances of the points are kept in store_ from here on.
+    // With n_threads > 1 the top of the tree is split on the calling thread
+    // and the subtrees below it are built on a worker pool; the tree is the
+    // same for any n_threads.
+    void buildKDtree(size_t n_threads = 1);
 
     NodePtr get_root() const { return this->root_; };
 
     void init(const _Point &ref);
 
-    virtual _Point max_point() = 0;
+    void init(const _Point *refs, size_t n_refs);
 
-    virtual void sample(size_t sample_num) = 0;
+    void flush(S *dist_out);
+
+    // Position in the point array of the point farthest from the samples.
+    virtual size_t max_index() const = 0;
+
+    // Fill sample_points[first, sample_num), stopping early once the
+    // farthest point is closer than stop_dis (a squared distance) to the
+    // sample set. Samples before `first` must already be folded into the
+    // tree, so a later call continues where an earlier one stopped.
+    // Returns the number of samples held afterwards.
+    virtual size_t sample(size_t sample_num, S stop_dis = 0,
+                          size_t first = 1) = 0;
 
   protected:
-    void deleteNode(NodePtr node_p);
+    // A node whose points are in [left, right) of the point array, at depth
+    // high and in arena slot `slot`, still to be split.
+    struct Subtree {
+        NodePtr node;
+        ssize_t left, right;
+        size_t high, slot;
+    };
+
+    // Subtrees of fewer points are not worth a task of their own.
+    static constexpr size_t kMinTaskPoints = size_t(1) << 14;
+
+    NodeArena<KDNode<T, DIM, S>> nodes_;
+    DelayPool delays_;
+    BucketStore<T, DIM, S> store_;
+
+    // Called for every leaf, left to right, once the tree is built.
     virtual void addNode(NodePtr p) = 0;
     virtual bool leftNode(size_t high, size_t count) const = 0;
-    virtual void update_distance(const _Point &ref_point) = 0;
-
-    NodePtr divideTree(ssize_t left, ssize_t right,
-                       const std::array<_Interval, DIM> &bboxs,
-                       size_t curr_high);
-
-    size_t planeSplit(ssize_t left, ssize_t right, size_t split_dim,
-                      T split_val);
+    // Upper bound on the number of nodes of a subtree over `count` points
+    // rooted at depth `high`. Splits never leave a side empty, so it has at
+    // most 2 * count - 1 nodes. The bound of a node is at least one more
+    // than those of its children together, which gives every subtree a
+    // range of arena slots of its own.
+    virtual size_t nodeCapacity(size_t count, size_t) const {
+        return count == 0 ? 1 : 2 * count - 1;
+    }
+    // Fold sample_points[ref] into the tree.
+    virtual void update_distance(uint32_t ref) = 0;
 
-    T qSelectMedian(size_t dim, size_t left, size_t right);
-    static size_t findSplitDim(const std::array<_Interval, DIM> &bboxs);
-    inline std::array<_Interval, DIM> computeBoundingBox(size_t left,
-                                                         size_t right);
+    // Split `tree` down to its leaves. With `deferred` set, subtrees of at
+    // most `cutoff` points are left unsplit and appended to it instead.
+    void divideTree(const Subtree &tree, size_t cutoff,
+                    std::vector<Subtree> *deferred);
 };
 
 template <typename T, size_t DIM, typename S>
@@ -67,149 +104,112 @@ KDTreeBase<T, DIM, S>::KDTreeBase(_Points data, size_t pointSize,
       points_(data) {}
 
 template <typename T, size_t DIM, typename S>
-KDTreeBase<T, DIM, S>::~KDTreeBase() {
-    if (root_ != nullptr)
-        deleteNode(root_);
-}
-
-template <typename T, size_t DIM, typename S>
-void KDTreeBase<T, DIM, S>::deleteNode(NodePtr node_p) {
-    if (node_p->left)
-        deleteNode(node_p->left);
-    if (node_p->right)
-        deleteNode(node_p->right);
-    delete node_p;
-}
-
-template <typename T, size_t DIM, typename S>
-void KDTreeBase<T, DIM, S>::buildKDtree() {
+void KDTreeBase<T, DIM, S>::buildKDtree(size_t n_threads) {
     size_t left = 0;
     size_t right = pointSize;
-    std::array<_Interval, DIM> bboxs = this->computeBoundingBox(left, right);
-    this->root_ = divideTree(left, right, bboxs, 0);
+    std::array<_Interval, DIM> bboxs =
+        computeBoundingBox(this->points_, left, right);
+    this->nodes_.reset(this->nodeCapacity(pointSize, 0));
+    this->root_ = this->nodes_.create(0, bboxs);
+    Subtree root{this->root_, static_cast<ssize_t>(left),
+                 static_cast<ssize_t>(right), 0, 0};
+    if (n_threads <= 1) {
+        divideTree(root, 0, nullptr);
+    } else {
+        // a few subtrees per thread, so that uneven ones still balance
+        size_t cutoff =
+            std::max(pointSize / (4 * n_threads), kMinTaskPoints);
+        std::vector<Subtree> deferred;
+        divideTree(root, cutoff, &deferred);
+        threading::parallel_for_stealing(
+            deferred.size(), n_threads,
+            [&](size_t k) { return deferred[k].right - deferred[k].left; },
+            [&](size_t k) { divideTree(deferred[k], 0, nullptr); });
+    }
+
+    std::vector<NodePtr> stack(1, this->root_);
+    while (!stack.empty()) {
+        NodePtr node = stack.back();
+        stack.pop_back();
+        if (node->left && node->right) {
+            stack.push_back(node->right);
+            stack.push_back(node->left);
+        } else {
+            this->addNode(node);
+        }
+    }
+    this->store_.assign(this->points_, pointSize);
 }
 
+// The children of a node in slot s take the slots right after it: the left
+// subtree from s + 1 on, the right one after the range the left one may use.
 template <typename T, size_t DIM, typename S>
-typename KDTreeBase<T, DIM, S>::NodePtr
-KDTreeBase<T, DIM, S>::divideTree(ssize_t left, ssize_t right,
-                                  const std::array<_Interval, DIM> &bboxs,
-                                  size_t curr_high) {
-    NodePtr node = new KDNode<T, DIM, S>(bboxs);
+void KDTreeBase<T, DIM, S>::divideTree(const Subtree &tree, size_t cutoff,
+                                       std::vector<Subtree> *deferred) {
+    NodePtr node = tree.node;
+    node->points = this->points_;
 
+    ssize_t left = tree.left, right = tree.right;
     ssize_t count = right - left;
-    if (this->leftNode(curr_high, count)) {
+    if (this->leftNode(tree.high, count)) {
         node->pointLeft = left;
         node->pointRight = right;
-        node->points = this->points_;
-        this->addNode(node);
-        return node;
-    } else {
-        size_t split_dim = this->findSplitDim(bboxs);
-        T split_val = this->qSelectMedian(split_dim, left, right);
-
-        size_t split_delta = planeSplit(left, right, split_dim, split_val);
-
-        std::array<_Interval, DIM> bbox_cur =
-            this->computeBoundingBox(left, left + split_delta);
-        node->left =
-            this->divideTree(left, left + split_delta, bbox_cur, curr_high + 1);
-        bbox_cur = this->computeBoundingBox(left + split_delta, right);
-        node->right = this->divideTree(left + split_delta, right, bbox_cur,
-                                       curr_high + 1);
-        return node;
+        return;
     }
-}
-
-template <typename T, size_t DIM, typename S>
-size_t KDTreeBase<T, DIM, S>::planeSplit(ssize_t left, ssize_t right,
-                                         size_t split_dim, T split_val) {
-    ssize_t start = left;
-    ssize_t end = right - 1;
-
-    for (;;) {
-        while (start <= end && points_[start].pos[split_dim] < split_val)
-            ++start;
-        while (start <= end && points_[end].pos[split_dim] >= split_val)
-            --end;
-
-        if (start > end)
-            break;
-        std::swap(points_[start], points_[end]);
-        ++start;
-        --end;
+    if (deferred && static_cast<size_t>(count) <= cutoff) {
+        deferred->push_back(tree);
+        return;
     }
 
-    ssize_t lim1 = start - left;
-    if (start == left)
-        lim1 = 1;
-    if (start == right)
-        lim1 = (right - left - 1);
-
-    return static_cast<ssize_t>(lim1);
+    size_t split_dim = findSplitDim(node->bboxs);
+    T split_val = qSelectMedian(this->points_, split_dim, left, right);
+
+    std::array<_Interval, DIM> left_bboxs, right_bboxs;
+    size_t split_delta = planeSplit(this->points_, left, right, split_dim,
+                                    split_val, left_bboxs, right_bboxs);
+
+    size_t left_slot = tree.slot + 1;
+    size_t right_slot =
+        left_slot + this->nodeCapacity(split_delta, tree.high + 1);
+    node->left = this->nodes_.create(left_slot, left_bboxs);
+    node->right = this->nodes_.create(right_slot, right_bboxs);
+    divideTree({node->left, left, left + static_cast<ssize_t>(split_delta),
+                tree.high + 1, left_slot},
+               cutoff, deferred);
+    divideTree({node->right, left + static_cast<ssize_t>(split_delta), right,
+                tree.high + 1, right_slot},
+               cutoff, deferred);
 }
 
 template <typename T, size_t DIM, typename S>
-T KDTreeBase<T, DIM, S>::qSelectMedian(size_t dim, size_t left, size_t right) {
-    T sum = std::accumulate(this->points_ + left, this->points_ + right, 0.0,
-                            [dim](const T &acc, const _Point &point) {
-                                return acc + point.pos[dim];
-                            });
-    return sum / (right - left);
-}
-
-template <typename T, size_t DIM, typename S>
-size_t
-KDTreeBase<T, DIM, S>::findSplitDim(const std::array<_Interval, DIM> &bboxs) {
-    T min_, max_;
-    T span = 0;
-    size_t best_dim = 0;
-
-    for (size_t cur_dim = 0; cur_dim < DIM; cur_dim++) {
-        min_ = bboxs[cur_dim].low;
-        max_ = bboxs[cur_dim].high;
-        T cur_span = (max_ - min_);
-
-        if (cur_span > span) {
-            best_dim = cur_dim;
-            span = cur_span;
-        }
-    }
-
-    return best_dim;
+void KDTreeBase<T, DIM, S>::init(const _Point &ref) {
+    this->init(&ref, 1);
 }
 
+// Seed the sampling with n_refs points, which become the first samples. All
+// of them are folded into the tree in a single pass over the leaves. The dis
+// of each seed in sample_points is its distance to the seeds before it.
 template <typename T, size_t DIM, typename S>
-inline std::array<Interval<T>, DIM>
-KDTreeBase<T, DIM, S>::computeBoundingBox(size_t left, size_t right) {
-    T min_vals[DIM];
-    T max_vals[DIM];
-    std::fill(min_vals, min_vals + DIM, std::numeric_limits<T>::max());
-    std::fill(max_vals, max_vals + DIM, std::numeric_limits<T>::lowest());
-
-    for (size_t i = left; i < right; ++i) {
-        const _Point &pos = points_[i];
-
-        for (size_t cur_dim = 0; cur_dim < DIM; cur_dim++) {
-            T val = pos[cur_dim];
-            min_vals[cur_dim] = std::min(min_vals[cur_dim], val);
-            max_vals[cur_dim] = std::max(max_vals[cur_dim], val);
-        }
-    }
-
-    std::array<_Interval, DIM> bboxs;
-
-    for (size_t cur_dim = 0; cur_dim < DIM; cur_dim++) {
-        bboxs[cur_dim].low = min_vals[cur_dim];
-        bboxs[cur_dim].high = max_vals[cur_dim];
+void KDTreeBase<T, DIM, S>::init(const _Point *refs, size_t n_refs) {
+    for (size_t i = 0; i < n_refs; i++) {
+        this->sample_points[i] = refs[i];
+        this->sample_points[i].reset();
+        for (size_t j = 0; j < i; j++)
+            this->sample_points[i].updatedistance(refs[j]);
     }
-
-    return bboxs;
+    this->delays_.reset(this->nodes_.size());
+    // a leaf applies its full queue and one more sample at a time
+    this->store_.reserve_refs(std::max(n_refs, DelayPool::kCapacity + 1));
+    this->root_->init(refs, n_refs, this->store_);
 }
 
+// Apply all delayed updates and write the squared distance of every point
+// to the sample set into dist_out, indexed by point id.
 template <typename T, size_t DIM, typename S>
-void KDTreeBase<T, DIM, S>::init(const _Point &ref) {
-    this->sample_points[0] = ref;
-    this->root_->init(ref);
+void KDTreeBase<T, DIM, S>::flush(S *dist_out) {
+    this->root_->flush(this->delays_, this->store_, this->sample_points);
+    for (size_t i = 0; i < pointSize; i++)
+        dist_out[points_[i].id] = this->store_.dis(i);
 }
 
 } // namespace quickfps
@@ -0,0 +1,65 @@
+//
+// Contiguous node storage for the KD trees.
+//
+
+#ifndef KD_TREE_BASED_FARTHEST_POINT_SAMPLING_NODEARENA_H
+#define KD_TREE_BASED_FARTHEST_POINT_SAMPLING_NODEARENA_H
+
+#include <cassert>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace quickfps {
+
+// Fixed-capacity storage for the nodes of one tree. Nodes are constructed in
+// place and never move, so they can point to each other. The builder picks
+// the slot of every node, so disjoint subtrees can be filled from different
+// threads, and slots it skips stay unused. reset() drops all nodes at once
+// without running destructors and keeps the storage for the next build as
+// long as it is large enough.
+template <typename Node> class NodeArena {
+    static_assert(std::is_trivially_destructible<Node>::value,
+                  "the arena never destroys its nodes");
+
+  public:
+    NodeArena() = default;
+    NodeArena(const NodeArena &) = delete;
+    NodeArena &operator=(const NodeArena &) = delete;
+
+    // Drop all nodes and make room for `capacity` new ones.
+    void reset(size_t capacity) {
+        if (capacity > capacity_) {
+            slots_.reset(new Slot[capacity]);
+            capacity_ = capacity;
+        }
+        size_ = capacity;
+    }
+
+    // Construct a node in `slot`, which must be below the capacity given to
+    // reset() and not hold a node yet.
+    template <typename... Args> Node *create(size_t slot, Args &&...args) {
+        assert(slot < size_);
+        Node *node = reinterpret_cast<Node *>(&slots_[slot]);
+        new (node) Node(std::forward<Args>(args)...);
+        return node;
+    }
+
+    // Number of slots of the current tree, an upper bound on its nodes.
+    size_t size() const { return size_; }
+
+  private:
+    struct alignas(Node) Slot {
+        unsigned char bytes[sizeof(Node)];
+    };
+
+    std::unique_ptr<Slot[]> slots_;
+    size_t capacity_ = 0;
+    size_t size_ = 0;
+};
+
+} // namespace quickfps
+
+#endif // KD_TREE_BASED_FARTHEST_POINT_SAMPLING_NODEARENA_H
@@ -6,13 +6,14 @@
 #ifndef KD_TREE_BASED_FARTHEST_POINT_SAMPLING_POINT_H
 #define KD_TREE_BASED_FARTHEST_POINT_SAMPLING_POINT_H
 
-#include "cmath"
 #include "utils.h"
 #include <algorithm>
 #include <limits>
 
 namespace quickfps {
 
+// Trivially copyable, so the copies and swaps of the tree build compile to
+// plain moves of the bytes.
 template <typename T, size_t DIM, typename S = T> class Point {
   public:
     T pos[DIM]; // x, y, z
@@ -22,20 +23,11 @@ template <typename T, size_t DIM, typename S = T> class Point {
     Point();
     Point(const T pos[DIM], size_t id);
     Point(const T pos[DIM], size_t id, S dis);
-    Point(const Point &obj);
-    ~Point(){};
 
     bool operator<(const Point &aii) const;
 
     constexpr T operator[](size_t i) const { return pos[i]; }
 
-    Point &operator=(const Point &obj) {
-        std::copy(obj.pos, obj.pos + DIM, this->pos);
-        this->dis = obj.dis;
-        this->id = obj.id;
-        return *this;
-    }
-
     constexpr S distance(const Point &b) { return _distance(b, DIM); }
 
     void reset();
@@ -46,10 +38,12 @@ template <typename T, size_t DIM, typename S = T> class Point {
 
   private:
     constexpr S _distance(const Point &b, size_t dim_left) {
-        return (dim_left == 0)
-                   ? 0
-                   : powi((this->pos[dim_left - 1] - b.pos[dim_left - 1]), 2) +
-                         _distance(b, dim_left - 1);
+        S dis(0);
+        for (size_t cur_dim = 0; cur_dim < dim_left; cur_dim++) {
+            T d = this->pos[cur_dim] - b.pos[cur_dim];
+            dis += d * d;
+        }
+        return dis;
     }
 };
 
@@ -69,11 +63,6 @@ Point<T, DIM, S>::Point(const T pos[DIM], size_t id, S dis) : dis(dis), id(id) {
     std::copy(pos, pos + DIM, this->pos);
 }
 
-template <typename T, size_t DIM, typename S>
-Point<T, DIM, S>::Point(const Point &obj) : dis(obj.dis), id(obj.id) {
-    std::copy(obj.pos, obj.pos + DIM, this->pos);
-}
-
 template <typename T, size_t DIM, typename S>
 bool Point<T, DIM, S>::operator<(const Point &aii) const {
     return dis < aii.dis;
@@ -0,0 +1,27 @@
+#ifndef FPSAMPLE_DISPATCH_HPP
+#define FPSAMPLE_DISPATCH_HPP
+
+#include <array>
+#include <cstddef>
+#include <utility>
+
+////////////////////////////////////////
+//                                    //
+//    Compile Time Function Helper    //
+//                                    //
+////////////////////////////////////////
+
+// map<T, Count>(m) builds {m.operator()<1>(), ..., m.operator()<Count>()}.
+// Used to turn a DIM-templated function into a table indexed by `dim - 1`.
+template <typename T, size_t Count, typename M, size_t... I>
+constexpr std::array<T, Count> mapIndices(M &&m, std::index_sequence<I...>) {
+    std::array<T, Count> result{m.template operator()<I + 1>()...};
+    return result;
+}
+
+template <typename T, size_t Count, typename M>
+constexpr std::array<T, Count> map(M m) {
+    return mapIndices<T, Count>(m, std::make_index_sequence<Count>());
+}
+
+#endif // FPSAMPLE_DISPATCH_HPP
@@ -1,18 +1,28 @@
 from __future__ import annotations
 
+import numbers
 import warnings
-from typing import List, Optional, Union
+from typing import List, Optional, Tuple, Union
 
 import numpy as np
 
 from ._fpsample import (
+    _FPSSampler,
     __doc__,
     __version__,
+    _batch_sampling,
     _bucket_fps_kdline_sampling,
     _bucket_fps_kdtree_sampling,
+    _fps_kdtree_sampling,
     _fps_npdu_kdtree_sampling,
     _fps_npdu_sampling,
+    _fps_npdu_graph_sampling,
     _fps_sampling,
+    _geodesic_fps_sampling,
+    _knn_graph,
+    _mesh_graph,
+    _ragged_sampling,
+    _simd_isa,
 )
 
 
@@ -32,37 +42,75 @@ def get_start_idx(n_pts: int, start_idx: Optional[Union[int, List[int]]]) -> Uni
     return start_idx
 
 
+def check_start_idx(n_pts: int, n_samples: int, start_idx: Optional[Union[int, List[int]]]) -> None:
+    if isinstance(start_idx, int):
+        assert 0 <= start_idx < n_pts, "start_idx should be None or 0 <= start_idx < n_pts"
+    if isinstance(start_idx, list):
+        assert 1 <= len(start_idx) <= n_samples, "len(start_idx) should be between 1 and n_samples"
+        for idx in start_idx:
+            assert 0 <= idx < n_pts, "start_idx should be None or 0 <= start_idx < n_pts"
+
+
+def _with_distances(res, return_radii: bool, return_dist_min: bool, squared: bool = True):
+    # The extension fills None for the outputs not requested, and reports squared distances unless `squared` is
+    # False; callers get only the requested arrays, with Euclidean distances
+    if not (return_radii or return_dist_min):
+        return res
+    idx, radii, dist_min = res
+    out = [idx]
+    if return_radii:
+        out.append(np.sqrt(radii, out=radii) if squared else radii)
+    if return_dist_min:
+        out.append(np.sqrt(dist_min, out=dist_min) if squared else dist_min)
+    return tuple(out)
+
+
 def fps_sampling(
-    pc: np.ndarray, n_samples: int, start_idx: Optional[Union[int, List[int]]] = None
-) -> np.ndarray:
+    pc: np.ndarray,
+    n_samples: int,
+    start_idx: Optional[Union[int, List[int]]] = None,
+    num_threads: int = 1,
+    return_radii: bool = False,
+    return_dist_min: bool = False,
+    radius: Optional[float] = None,
+) -> Union[np.ndarray, Tuple[np.ndarray, ...]]:
     """
     Vanilla FPS sampling.
 
     Args:
         pc (np.ndarray): The input point cloud of shape (n_pts, D).
-        n_samples (int): Number of samples.
+        n_samples (int): Number of samples. If `radius` is set, the maximum number of samples, which may exceed n_pts.
         start_idx (int or list[int], default=None): The starting index of sampling. If set to None, it will be randomly picked.
             If multiple start indices are given, they are used as a start set for the FPS and will all be present in the final samples.
+        num_threads (int, default=1): Number of threads used for the distance update. 0 uses all cores.
+            The result is identical for any number of threads.
+        return_radii (bool, default=False): Also return the insertion radius of each sample, i.e. its distance
+            to the samples picked before it (inf for the first one), of shape (n_samples,).
+        return_dist_min (bool, default=False): Also return the final distance of every point to the sample set,
+            of shape (n_pts,).
+        radius (float, default=None): If set, stop as soon as every point is closer than `radius` to a sample.
+            Fewer than `n_samples` indices are returned then.
     Returns:
         np.ndarray: The selected indices of shape (n_samples,).
+            If `return_radii` or `return_dist_min` is set, a tuple of the indices followed by the requested arrays.
     """
     assert n_samples >= 1, "n_samples should be >= 1"
+    assert radius is None or radius >= 0, "radius should be None or >= 0"
     assert pc.ndim == 2
+    assert num_threads >= 0, "num_threads should be >= 0"
     n_pts, _ = pc.shape
-    assert n_pts >= n_samples, "n_pts should be >= n_samples"
-    if isinstance(start_idx, int):
-        assert (
-            start_idx is None or 0 <= start_idx < n_pts
-        ), "start_idx should be None or 0 <= start_idx < n_pts"
-    if isinstance(start_idx, list):
-        assert len(start_idx) <= n_samples, "len(start_idx) should be <= n_samples"
-        for idx in start_idx:
-            assert 0 <= idx < n_pts, "start_idx should be None or 0 <= start_idx < n_pts"
-    # best performance with fortran array
-    pc = np.asfortranarray(pc, dtype=np.float32)
+    if radius is None:
+        assert n_pts >= n_samples, "n_pts should be >= n_samples"
+    else:
+        # the radius bounds the sample count, n_samples only caps it
+        n_samples = min(n_samples, n_pts)
+    check_start_idx(n_pts, n_samples, start_idx)
+    # C- and Fortran-ordered float32 arrays are sampled in place, without any copy
+    pc = np.asarray(pc, dtype=np.float32)
     # Random pick a start if not given
     start_idx = get_start_idx(n_pts, start_idx)
-    return _fps_sampling(pc, n_samples, start_idx)
+    res = _fps_sampling(pc, n_samples, start_idx, num_threads, return_radii, return_dist_min, radius or 0.0)
+    return _with_distances(res, return_radii, return_dist_min)
 
 
 def fps_npdu_sampling(
@@ -70,10 +118,13 @@ def fps_npdu_sampling(
     n_samples: int,
     w: Optional[int] = None,
     start_idx: Optional[Union[int, List[int]]] = None,
-) -> np.ndarray:
+    return_radii: bool = False,
+    return_dist_min: bool = False,
+    reorder: bool = False,
+) -> Union[np.ndarray, Tuple[np.ndarray, ...]]:
     """
     FPS sampling with nearest-point-distance-updating (NPDU) heuristic strategy.
-    **Requires dimensional locality for best samples**.
+    **Requires dimensional locality for best samples**, unless `reorder` is set.
 
     Args:
         pc (np.ndarray): The input point cloud of shape (n_pts, D).
@@ -81,18 +132,22 @@ def fps_npdu_sampling(
         w (int, default=None): Windows size of local heuristic search. If set to None, it will be set to `n_pts / n_samples * 16`.
         start_idx (int or list[int], default=None): The starting index of sampling. If set to None, it will be randomly picked.
             If multiple start indices are given, they are used as a start set for the FPS and will all be present in the final samples.
+        return_radii (bool, default=False): Also return the insertion radius of each sample, i.e. its distance
+            to the samples picked before it (inf for the first one), of shape (n_samples,).
+        return_dist_min (bool, default=False): Also return the final distance of every point to the sample set,
+            of shape (n_pts,).
+            Both are the distances tracked by the heuristic, which can be larger than the exact ones.
+        reorder (bool, default=False): Sort the points along a Morton (Z-order) curve before sampling, so the window
+            holds spatial neighbours for clouds in arbitrary order. Indices and `dist_min` are still in the input order.
     Returns:
         np.ndarray: The selected indices of shape (n_samples,).
+            If `return_radii` or `return_dist_min` is set, a tuple of the indices followed by the requested arrays.
     """
     assert n_samples >= 1, "n_samples should be >= 1"
     assert pc.ndim == 2
     n_pts, _ = pc.shape
     assert n_pts >= n_samples, "n_pts should be >= n_samples"
-    assert (
-        start_idx is None or 0 <= start_idx < n_pts
-    ), "start_idx should be None or 0 <= start_idx < n_pts"
-    if isinstance(start_idx, list):
-        assert len(start_idx) <= n_samples, "len(start_idx) should be <= n_samples"
+    check_start_idx(n_pts, n_samples, start_idx)
     pc = np.ascontiguousarray(pc, dtype=np.float32)
     w = w or int(n_pts / n_samples * 16)
     if w >= n_pts - 1:
@@ -100,7 +155,8 @@ def fps_npdu_sampling(
         w = n_pts - 1
     # Random pick a start if not given
     start_idx = get_start_idx(n_pts, start_idx)
-    return _fps_npdu_sampling(pc, n_samples, w, start_idx)
+    res = _fps_npdu_sampling(pc, n_samples, w, start_idx, return_radii, return_dist_min, reorder)
+    return _with_distances(res, return_radii, return_dist_min)
 
 
 def fps_npdu_kdtree_sampling(
@@ -108,7 +164,11 @@ def fps_npdu_kdtree_sampling(
     n_samples: int,
     w: Optional[int] = None,
     start_idx: Optional[Union[int, List[int]]] = None,
-) -> np.ndarray:
+    return_radii: bool = False,
+    return_dist_min: bool = False,
+    leaf_size: int = 10,
+    num_threads: int = 1,
+) -> Union[np.ndarray, Tuple[np.ndarray, ...]]:
     """
     FPS sampling with nearest-point-distance-updating (NPDU) heuristic strategy.
     Using KDTree to eliminate the need of dimensional locality.
@@ -120,18 +180,24 @@ def fps_npdu_kdtree_sampling(
         w (int, default=None): Windows size of local heuristic search. If set to None, it will be set to `n_pts / n_samples * 16`.
         start_idx (int or list[int], default=None): The starting index of sampling. If set to None, it will be randomly picked.
             If multiple start indices are given, they are used as a start set for the FPS and will all be present in the final samples.
+        return_radii (bool, default=False): Also return the insertion radius of each sample, i.e. its distance
+            to the samples picked before it (inf for the first one), of shape (n_samples,).
+        return_dist_min (bool, default=False): Also return the final distance of every point to the sample set,
+            of shape (n_pts,).
+            Both are the distances tracked by the heuristic, which can be larger than the exact ones.
+        leaf_size (int, default=10): Maximum number of points in a leaf of the KDTree.
+        num_threads (int, default=1): Number of threads used to build the KDTree. 0 uses all cores.
     Returns:
         np.ndarray: The selected indices of shape (n_samples,).
+            If `return_radii` or `return_dist_min` is set, a tuple of the indices followed by the requested arrays.
     """
     assert n_samples >= 1, "n_samples should be >= 1"
     assert pc.ndim == 2
     n_pts, _ = pc.shape
     assert n_pts >= n_samples, "n_pts should be >= n_samples"
-    assert (
-        start_idx is None or 0 <= start_idx < n_pts
-    ), "start_idx should be None or 0 <= start_idx < n_pts"
-    if isinstance(start_idx, list):
-        assert len(start_idx) <= n_samples, "len(start_idx) should be <= n_samples"
+    assert leaf_size >= 1, "leaf_size should be >= 1"
+    assert num_threads >= 0, "num_threads should be >= 0"
+    check_start_idx(n_pts, n_samples, start_idx)
     pc = np.ascontiguousarray(pc, dtype=np.float32)
     w = w or int(n_pts / n_samples * 16)
     if w >= n_pts:
@@ -139,71 +205,620 @@ def fps_npdu_kdtree_sampling(
         w = n_pts
     # Random pick a start if not given
     start_idx = get_start_idx(n_pts, start_idx)
-    return _fps_npdu_kdtree_sampling(pc, n_samples, w, start_idx)
+    res = _fps_npdu_kdtree_sampling(
+        pc, n_samples, w, start_idx, return_radii, return_dist_min, leaf_size, num_threads
+    )
+    return _with_distances(res, return_radii, return_dist_min)
 
 
-def bucket_fps_kdtree_sampling(
-    pc: np.ndarray, n_samples: int, start_idx: Optional[Union[int, List[int]]] = None
-) -> np.ndarray:
+def knn_graph(
+    pc: np.ndarray,
+    k: int,
+    leaf_size: int = 10,
+    num_threads: int = 0,
+) -> Tuple[np.ndarray, np.ndarray, np.ndarray]:
     """
-    Bucket-based FPS sampling using KDTree. Also called "QuickFPS" in the paper.
+    All-points k-nearest-neighbour graph of a point cloud in CSR form, built once with a KDTree and reusable
+    across sampling calls, see `fps_npdu_graph_sampling`.
+
+    Args:
+        pc (np.ndarray): The input point cloud of shape (n_pts, D).
+        k (int): Number of neighbours of every point, the point itself included. Capped at `n_pts`.
+        leaf_size (int, default=10): Maximum number of points in a leaf of the KDTree.
+        num_threads (int, default=0): Number of threads for the KDTree build and the queries. 0 uses all cores.
+    Returns:
+        Tuple[np.ndarray, np.ndarray, np.ndarray]: `(indptr, indices, distances)`. The neighbours of point i are
+            `indices[indptr[i]:indptr[i + 1]]`, nearest first, at the Euclidean `distances` of the same slice.
+    """
+    assert k >= 1, "k should be >= 1"
+    assert pc.ndim == 2
+    assert leaf_size >= 1, "leaf_size should be >= 1"
+    assert num_threads >= 0, "num_threads should be >= 0"
+    pc = np.ascontiguousarray(pc, dtype=np.float32)
+    indptr, indices, dist2 = _knn_graph(pc, k, leaf_size, num_threads)
+    return indptr, indices, np.sqrt(dist2)
+
+
+def fps_npdu_graph_sampling(
+    pc: np.ndarray,
+    n_samples: int,
+    graph: Tuple[np.ndarray, ...],
+    start_idx: Optional[Union[int, List[int]]] = None,
+    return_radii: bool = False,
+    return_dist_min: bool = False,
+) -> Union[np.ndarray, Tuple[np.ndarray, ...]]:
+    """
+    FPS sampling with NPDU heuristic strategy over a precomputed neighbourhood graph: every new sample updates
+    the points adjacent to it. With a graph from `knn_graph(pc, w)` this gives the samples of
+    `fps_npdu_kdtree_sampling(pc, n_samples, w)` with the same leaf size, without any KDTree work per call.
 
     Args:
         pc (np.ndarray): The input point cloud of shape (n_pts, D).
         n_samples (int): Number of samples.
+        graph (tuple): `(indptr, indices, ...)` CSR adjacency, such as the result of `knn_graph`. Further entries are ignored.
         start_idx (int or list[int], default=None): The starting index of sampling. If set to None, it will be randomly picked.
             If multiple start indices are given, they are used as a start set for the FPS and will all be present in the final samples.
+        return_radii (bool, default=False): Also return the insertion radius of each sample, i.e. its distance
+            to the samples picked before it (inf for the first one), of shape (n_samples,).
+        return_dist_min (bool, default=False): Also return the final distance of every point to the sample set,
+            of shape (n_pts,).
+            Both are the distances tracked by the heuristic, which can be larger than the exact ones.
     Returns:
         np.ndarray: The selected indices of shape (n_samples,).
+            If `return_radii` or `return_dist_min` is set, a tuple of the indices followed by the requested arrays.
     """
     assert n_samples >= 1, "n_samples should be >= 1"
     assert pc.ndim == 2
     n_pts, _ = pc.shape
     assert n_pts >= n_samples, "n_pts should be >= n_samples"
-    assert (
-        start_idx is None or 0 <= start_idx < n_pts
-    ), "start_idx should be None or 0 <= start_idx < n_pts"
-    if isinstance(start_idx, list):
-        assert len(start_idx) <= n_samples, "len(start_idx) should be <= n_samples"
+    check_start_idx(n_pts, n_samples, start_idx)
+    pc = np.ascontiguousarray(pc, dtype=np.float32)
+    indptr, indices = graph[0], graph[1]
+    # Random pick a start if not given
+    start_idx = get_start_idx(n_pts, start_idx)
+    res = _fps_npdu_graph_sampling(pc, n_samples, indptr, indices, start_idx, return_radii, return_dist_min)
+    return _with_distances(res, return_radii, return_dist_min)
+
+
+def mesh_graph(pc: np.ndarray, faces: np.ndarray) -> Tuple[np.ndarray, np.ndarray, np.ndarray]:
+    """
+    Edge graph of a triangle mesh in CSR form, see `geodesic_fps_sampling`.
+
+    Args:
+        pc (np.ndarray): The mesh vertices of shape (n_pts, D).
+        faces (np.ndarray): Vertex indices of the triangles, of shape (n_faces, 3).
+    Returns:
+        Tuple[np.ndarray, np.ndarray, np.ndarray]: `(indptr, indices, lengths)`. The neighbours of vertex i are
+            `indices[indptr[i]:indptr[i + 1]]`, in increasing order, with the Euclidean edge `lengths` of the same slice.
+    """
+    assert pc.ndim == 2
+    faces = np.asarray(faces)
+    assert faces.ndim == 2 and faces.shape[1] == 3, "faces should be of shape (n_faces, 3)"
+    assert faces.size == 0 or (faces.min() >= 0 and faces.max() < pc.shape[0]), "faces should index into pc"
+    pc = np.ascontiguousarray(pc, dtype=np.float32)
+    return _mesh_graph(pc, faces.astype(np.uint32))
+
+
+def geodesic_fps_sampling(
+    pc: np.ndarray,
+    n_samples: int,
+    graph: Optional[Tuple[np.ndarray, ...]] = None,
+    faces: Optional[np.ndarray] = None,
+    start_idx: Optional[Union[int, List[int]]] = None,
+    return_radii: bool = False,
+    return_dist_min: bool = False,
+) -> Union[np.ndarray, Tuple[np.ndarray, ...]]:
+    """
+    Geodesic FPS sampling: distances are shortest paths along the edges of a graph, so thin structures such as
+    poles and walls are not over-sampled the way they are with Euclidean distances. Every new sample runs a
+    Dijkstra search that stops wherever it no longer brings points closer to the sample set.
+    Points that no sample can reach get the next samples, so every connected component is covered.
+
+    Args:
+        pc (np.ndarray): The input point cloud or mesh vertices of shape (n_pts, D).
+        n_samples (int): Number of samples.
+        graph (tuple, default=None): `(indptr, indices)` or `(indptr, indices, weights)` CSR adjacency, such as the
+            result of `knn_graph` or `mesh_graph`. Edges are followed in the stored direction, and missing weights
+            are the Euclidean edge lengths.
+        faces (np.ndarray, default=None): Triangle faces of shape (n_faces, 3), instead of `graph`.
+        start_idx (int or list[int], default=None): The starting index of sampling. If set to None, it will be randomly picked.
+            If multiple start indices are given, they are used as a start set for the FPS and will all be present in the final samples.
+        return_radii (bool, default=False): Also return the geodesic insertion radius of each sample, i.e. its distance
+            to the samples picked before it (inf for the first one and for unreachable points), of shape (n_samples,).
+        return_dist_min (bool, default=False): Also return the final geodesic distance of every point to the sample set,
+            of shape (n_pts,).
+    Returns:
+        np.ndarray: The selected indices of shape (n_samples,).
+            If `return_radii` or `return_dist_min` is set, a tuple of the indices followed by the requested arrays.
+    """
+    assert n_samples >= 1, "n_samples should be >= 1"
+    assert (graph is None) != (faces is None), "exactly one of graph or faces should be given"
+    assert pc.ndim == 2
+    n_pts, _ = pc.shape
+    assert n_pts >= n_samples, "n_pts should be >= n_samples"
+    check_start_idx(n_pts, n_samples, start_idx)
+    if faces is not None:
+        graph = mesh_graph(pc, faces)
+    pc = np.ascontiguousarray(pc, dtype=np.float32)
+    indptr, indices = graph[0], graph[1]
+    weights = graph[2] if len(graph) > 2 else None
+    # Random pick a start if not given
+    start_idx = get_start_idx(n_pts, start_idx)
+    res = _geodesic_fps_sampling(pc, n_samples, indptr, indices, weights, start_idx, return_radii, return_dist_min)
+    # the distances are already geodesic, not squared
+    return _with_distances(res, return_radii, return_dist_min, squared=False)
+
+
+def fps_kdtree_sampling(
+    pc: np.ndarray,
+    n_samples: int,
+    start_idx: Optional[Union[int, List[int]]] = None,
+    return_radii: bool = False,
+    return_dist_min: bool = False,
+    radius: Optional[float] = None,
+    leaf_size: int = 10,
+    num_threads: int = 1,
+) -> Union[np.ndarray, Tuple[np.ndarray, ...]]:
+    """
+    Exact FPS sampling on a KDTree. Each new sample only updates the points within the current
+    farthest-point distance of it, found with a radius search, so late iterations touch a small neighbourhood.
+    Gives the same result as `fps_sampling`.
+
+    Args:
+        pc (np.ndarray): The input point cloud of shape (n_pts, D).
+        n_samples (int): Number of samples. If `radius` is set, the maximum number of samples, which may exceed n_pts.
+        start_idx (int or list[int], default=None): The starting index of sampling. If set to None, it will be randomly picked.
+            If multiple start indices are given, they are used as a start set for the FPS and will all be present in the final samples.
+        return_radii (bool, default=False): Also return the insertion radius of each sample, i.e. its distance
+            to the samples picked before it (inf for the first one), of shape (n_samples,).
+        return_dist_min (bool, default=False): Also return the final distance of every point to the sample set,
+            of shape (n_pts,).
+        radius (float, default=None): If set, stop as soon as every point is closer than `radius` to a sample.
+            Fewer than `n_samples` indices are returned then.
+        leaf_size (int, default=10): Maximum number of points in a leaf of the KDTree.
+        num_threads (int, default=1): Number of threads used to build the KDTree. 0 uses all cores.
+    Returns:
+        np.ndarray: The selected indices of shape (n_samples,).
+            If `return_radii` or `return_dist_min` is set, a tuple of the indices followed by the requested arrays.
+    """
+    assert n_samples >= 1, "n_samples should be >= 1"
+    assert radius is None or radius >= 0, "radius should be None or >= 0"
+    assert pc.ndim == 2
+    n_pts, _ = pc.shape
+    if radius is None:
+        assert n_pts >= n_samples, "n_pts should be >= n_samples"
+    else:
+        # the radius bounds the sample count, n_samples only caps it
+        n_samples = min(n_samples, n_pts)
+    assert leaf_size >= 1, "leaf_size should be >= 1"
+    assert num_threads >= 0, "num_threads should be >= 0"
+    check_start_idx(n_pts, n_samples, start_idx)
+    pc = np.ascontiguousarray(pc, dtype=np.float32)
+    # Random pick a start if not given
+    start_idx = get_start_idx(n_pts, start_idx)
+    res = _fps_kdtree_sampling(
+        pc, n_samples, start_idx, return_radii, return_dist_min, radius or 0.0, leaf_size, num_threads
+    )
+    return _with_distances(res, return_radii, return_dist_min)
+
+
+def bucket_fps_kdtree_sampling(
+    pc: np.ndarray,
+    n_samples: int,
+    start_idx: Optional[Union[int, List[int]]] = None,
+    return_radii: bool = False,
+    return_dist_min: bool = False,
+    radius: Optional[float] = None,
+    layout: str = "pointer",
+    num_threads: int = 1,
+) -> Union[np.ndarray, Tuple[np.ndarray, ...]]:
+    """
+    Bucket-based FPS sampling using KDTree. Also called "QuickFPS" in the paper.
+
+    Args:
+        pc (np.ndarray): The input point cloud of shape (n_pts, D).
+        n_samples (int): Number of samples. If `radius` is set, the maximum number of samples, which may exceed n_pts.
+        start_idx (int or list[int], default=None): The starting index of sampling. If set to None, it will be randomly picked.
+            If multiple start indices are given, they are used as a start set for the FPS and will all be present in the final samples.
+        return_radii (bool, default=False): Also return the insertion radius of each sample, i.e. its distance
+            to the samples picked before it (inf for the first one), of shape (n_samples,).
+        return_dist_min (bool, default=False): Also return the final distance of every point to the sample set,
+            of shape (n_pts,).
+        radius (float, default=None): If set, stop as soon as every point is closer than `radius` to a sample.
+            Fewer than `n_samples` indices are returned then.
+        layout (str, default="pointer"): Node layout of the KD tree. "flat" keeps the nodes in one array instead
+            of linking them by pointer. The samples are the same.
+        num_threads (int, default=1): Number of threads used to build the KDTree. 0 uses all cores.
+            The samples are the same.
+    Returns:
+        np.ndarray: The selected indices of shape (n_samples,).
+            If `return_radii` or `return_dist_min` is set, a tuple of the indices followed by the requested arrays.
+    """
+    assert n_samples >= 1, "n_samples should be >= 1"
+    assert radius is None or radius >= 0, "radius should be None or >= 0"
+    assert num_threads >= 0, "num_threads should be >= 0"
+    assert pc.ndim == 2
+    n_pts, _ = pc.shape
+    if radius is None:
+        assert n_pts >= n_samples, "n_pts should be >= n_samples"
+    else:
+        # the radius bounds the sample count, n_samples only caps it
+        n_samples = min(n_samples, n_pts)
+    check_start_idx(n_pts, n_samples, start_idx)
     pc = np.ascontiguousarray(pc, dtype=np.float32)
     # Random pick a start if not given
     start_idx = get_start_idx(n_pts, start_idx)
-    return _bucket_fps_kdtree_sampling(pc, n_samples, start_idx)
+    res = _bucket_fps_kdtree_sampling(
+        pc, n_samples, start_idx, return_radii, return_dist_min, radius or 0.0, layout, num_threads
+    )
+    return _with_distances(res, return_radii, return_dist_min)
 
 
 def bucket_fps_kdline_sampling(
-    pc: np.ndarray, n_samples: int, h: int, start_idx: Optional[Union[int, List[int]]] = None
-) -> np.ndarray:
+    pc: np.ndarray,
+    n_samples: int,
+    h: int,
+    start_idx: Optional[Union[int, List[int]]] = None,
+    return_radii: bool = False,
+    return_dist_min: bool = False,
+    radius: Optional[float] = None,
+    layout: str = "pointer",
+    num_threads: int = 1,
+) -> Union[np.ndarray, Tuple[np.ndarray, ...]]:
     """
     Bucket-based FPS sampling using KDTree, with multiple points in each bucket. Also called "QuickFPS" in the paper.
 
     Args:
         pc (np.ndarray): The input point cloud of shape (n_pts, D).
-        n_samples (int): Number of samples.
+        n_samples (int): Number of samples. If `radius` is set, the maximum number of samples, which may exceed n_pts.
         h (int, default=None): Height of KDTree. The bucket size is `2**h`.
             According to the paper, for small workload, h=3 is enough;
             for medium workload, h=5 or 7 is enough; for large workload, h=9 is enough.
         start_idx (int or list[int], default=None): The starting index of sampling. If set to None, it will be randomly picked.
             If multiple start indices are given, they are used as a start set for the FPS and will all be present in the final samples.
-
+        return_radii (bool, default=False): Also return the insertion radius of each sample, i.e. its distance
+            to the samples picked before it (inf for the first one), of shape (n_samples,).
+        return_dist_min (bool, default=False): Also return the final distance of every point to the sample set,
+            of shape (n_pts,).
+        radius (float, default=None): If set, stop as soon as every point is closer than `radius` to a sample.
+            Fewer than `n_samples` indices are returned then.
+        layout (str, default="pointer"): Node layout of the KD tree, see `bucket_fps_kdtree_sampling`.
+        num_threads (int, default=1): Number of threads used to build the KDTree. 0 uses all cores.
+            The samples are the same.
     Returns:
         np.ndarray: The selected indices of shape (n_samples,).
+            If `return_radii` or `return_dist_min` is set, a tuple of the indices followed by the requested arrays.
     """
     assert n_samples >= 1, "n_samples should be >= 1"
+    assert radius is None or radius >= 0, "radius should be None or >= 0"
+    assert num_threads >= 0, "num_threads should be >= 0"
     assert pc.ndim == 2
     n_pts, _ = pc.shape
-    assert n_pts >= n_samples, "n_pts should be >= n_samples"
+    if radius is None:
+        assert n_pts >= n_samples, "n_pts should be >= n_samples"
+    else:
+        # the radius bounds the sample count, n_samples only caps it
+        n_samples = min(n_samples, n_pts)
     assert h >= 1, "h should be >= 1"
     assert 2**h <= n_pts, "2**h should be <= n_pts"
-    assert (
-        start_idx is None or 0 <= start_idx < n_pts
-    ), "start_idx should be None or 0 <= start_idx < n_pts"
-    if isinstance(start_idx, list):
-        assert len(start_idx) <= n_samples, "len(start_idx) should be <= n_samples"
+    check_start_idx(n_pts, n_samples, start_idx)
     pc = np.ascontiguousarray(pc, dtype=np.float32)
     # Random pick a start if not given
     start_idx = get_start_idx(n_pts, start_idx)
-    return _bucket_fps_kdline_sampling(pc, n_samples, h, start_idx)
+    res = _bucket_fps_kdline_sampling(
+        pc, n_samples, h, start_idx, return_radii, return_dist_min, radius or 0.0, layout, num_threads
+    )
+    return _with_distances(res, return_radii, return_dist_min)
+
+
+def get_batch_start_idx(
+    n_batch: int, n_pts: int, start_idx: Optional[Union[int, List[int], np.ndarray]]
+) -> np.ndarray:
+    # One start index per cloud: random, shared, or given per cloud
+    if start_idx is None:
+        return np.random.randint(low=0, high=n_pts, size=n_batch).astype(np.uint64)
+    elif isinstance(start_idx, (numbers.Integral, np.integer)):
+        assert 0 <= start_idx < n_pts, "start_idx should be None or 0 <= start_idx < n_pts"
+        return np.full(n_batch, start_idx, dtype=np.uint64)
+    start_idx = np.asarray(start_idx)
+    assert start_idx.shape == (n_batch,), "start_idx should have one index per cloud"
+    assert np.all((0 <= start_idx) & (start_idx < n_pts)), "start_idx should be 0 <= start_idx < n_pts"
+    return start_idx.astype(np.uint64)
+
+
+def _batch_sampling_impl(
+    pcs: np.ndarray,
+    n_samples: int,
+    start_idx: Optional[Union[int, List[int], np.ndarray]],
+    method: str,
+    param: int,
+    num_threads: int,
+) -> np.ndarray:
+    assert n_samples >= 1, "n_samples should be >= 1"
+    assert pcs.ndim == 3, "pcs should be of shape (n_batch, n_pts, D)"
+    assert num_threads >= 0, "num_threads should be >= 0"
+    n_batch, n_pts, _ = pcs.shape
+    assert n_pts >= n_samples, "n_pts should be >= n_samples"
+    pcs = np.ascontiguousarray(pcs, dtype=np.float32)
+    start_idx = get_batch_start_idx(n_batch, n_pts, start_idx)
+    return _batch_sampling(pcs, n_samples, start_idx, method, param, num_threads)
+
+
+def fps_sampling_batch(
+    pcs: np.ndarray,
+    n_samples: int,
+    start_idx: Optional[Union[int, List[int], np.ndarray]] = None,
+    num_threads: int = 0,
+) -> np.ndarray:
+    """
+    Batched vanilla FPS sampling. Clouds are sampled in parallel, one per thread.
+
+    Args:
+        pcs (np.ndarray): The input point clouds of shape (n_batch, n_pts, D).
+        n_samples (int): Number of samples per cloud.
+        start_idx (int or list[int] or np.ndarray, default=None): The starting index of every cloud, of shape (n_batch,).
+            An int is shared by all clouds. If set to None, it will be randomly picked for each cloud.
+        num_threads (int, default=0): Number of threads. 0 uses all cores.
+    Returns:
+        np.ndarray: The selected indices of shape (n_batch, n_samples).
+    """
+    return _batch_sampling_impl(pcs, n_samples, start_idx, "fps", 0, num_threads)
+
+
+def fps_npdu_sampling_batch(
+    pcs: np.ndarray,
+    n_samples: int,
+    w: Optional[int] = None,
+    start_idx: Optional[Union[int, List[int], np.ndarray]] = None,
+    num_threads: int = 0,
+    reorder: bool = False,
+) -> np.ndarray:
+    """
+    Batched FPS sampling with NPDU heuristic strategy. See `fps_npdu_sampling`.
+
+    Args:
+        pcs (np.ndarray): The input point clouds of shape (n_batch, n_pts, D).
+        n_samples (int): Number of samples per cloud.
+        w (int, default=None): Windows size of local heuristic search. If set to None, it will be set to `n_pts / n_samples * 16`.
+        start_idx (int or list[int] or np.ndarray, default=None): The starting index of every cloud, of shape (n_batch,).
+            An int is shared by all clouds. If set to None, it will be randomly picked for each cloud.
+        num_threads (int, default=0): Number of threads. 0 uses all cores.
+        reorder (bool, default=False): Sort every cloud along a Morton curve first, see `fps_npdu_sampling`.
+    Returns:
+        np.ndarray: The selected indices of shape (n_batch, n_samples).
+    """
+    n_pts = pcs.shape[1]
+    w = w or int(n_pts / n_samples * 16)
+    if w >= n_pts - 1:
+        warnings.warn(f"k is too large, set to {n_pts - 1}")
+        w = n_pts - 1
+    method = "npdu_morton" if reorder else "npdu"
+    return _batch_sampling_impl(pcs, n_samples, start_idx, method, w, num_threads)
+
+
+def fps_npdu_kdtree_sampling_batch(
+    pcs: np.ndarray,
+    n_samples: int,
+    w: Optional[int] = None,
+    start_idx: Optional[Union[int, List[int], np.ndarray]] = None,
+    num_threads: int = 0,
+) -> np.ndarray:
+    """
+    Batched FPS sampling with NPDU heuristic strategy and KDTree. See `fps_npdu_kdtree_sampling`.
+
+    Args:
+        pcs (np.ndarray): The input point clouds of shape (n_batch, n_pts, D).
+        n_samples (int): Number of samples per cloud.
+        w (int, default=None): Windows size of local heuristic search. If set to None, it will be set to `n_pts / n_samples * 16`.
+        start_idx (int or list[int] or np.ndarray, default=None): The starting index of every cloud, of shape (n_batch,).
+            An int is shared by all clouds. If set to None, it will be randomly picked for each cloud.
+        num_threads (int, default=0): Number of threads. 0 uses all cores.
+    Returns:
+        np.ndarray: The selected indices of shape (n_batch, n_samples).
+    """
+    n_pts = pcs.shape[1]
+    w = w or int(n_pts / n_samples * 16)
+    if w >= n_pts:
+        warnings.warn(f"k is too large, set to {n_pts}")
+        w = n_pts
+    return _batch_sampling_impl(pcs, n_samples, start_idx, "npdu_kdtree", w, num_threads)
+
+
+def bucket_fps_kdtree_sampling_batch(
+    pcs: np.ndarray,
+    n_samples: int,
+    start_idx: Optional[Union[int, List[int], np.ndarray]] = None,
+    num_threads: int = 0,
+) -> np.ndarray:
+    """
+    Batched bucket-based FPS sampling using KDTree. See `bucket_fps_kdtree_sampling`.
+
+    Args:
+        pcs (np.ndarray): The input point clouds of shape (n_batch, n_pts, D).
+        n_samples (int): Number of samples per cloud.
+        start_idx (int or list[int] or np.ndarray, default=None): The starting index of every cloud, of shape (n_batch,).
+            An int is shared by all clouds. If set to None, it will be randomly picked for each cloud.
+        num_threads (int, default=0): Number of threads. 0 uses all cores.
+    Returns:
+        np.ndarray: The selected indices of shape (n_batch, n_samples).
+    """
+    return _batch_sampling_impl(pcs, n_samples, start_idx, "bucket_kdtree", 0, num_threads)
+
+
+def bucket_fps_kdline_sampling_batch(
+    pcs: np.ndarray,
+    n_samples: int,
+    h: int,
+    start_idx: Optional[Union[int, List[int], np.ndarray]] = None,
+    num_threads: int = 0,
+) -> np.ndarray:
+    """
+    Batched bucket-based FPS sampling using KDTree with multiple points in each bucket.
+    See `bucket_fps_kdline_sampling`.
+
+    Args:
+        pcs (np.ndarray): The input point clouds of shape (n_batch, n_pts, D).
+        n_samples (int): Number of samples per cloud.
+        h (int): Height of KDTree. The bucket size is `2**h`.
+        start_idx (int or list[int] or np.ndarray, default=None): The starting index of every cloud, of shape (n_batch,).
+            An int is shared by all clouds. If set to None, it will be randomly picked for each cloud.
+        num_threads (int, default=0): Number of threads. 0 uses all cores.
+    Returns:
+        np.ndarray: The selected indices of shape (n_batch, n_samples).
+    """
+    assert h >= 1, "h should be >= 1"
+    assert 2**h <= pcs.shape[1], "2**h should be <= n_pts"
+    return _batch_sampling_impl(pcs, n_samples, start_idx, "bucket_kdline", h, num_threads)
+
+
+_RAGGED_METHODS = ("fps", "fps_kdtree", "npdu", "npdu_morton", "npdu_kdtree", "bucket_kdtree", "bucket_kdline")
+
+
+def ragged_sampling(
+    pc: np.ndarray,
+    offsets: Union[List[int], np.ndarray],
+    n_samples: Union[int, List[int], np.ndarray],
+    method: str = "fps",
+    w: Optional[int] = None,
+    h: Optional[int] = None,
+    start_idx: Optional[Union[int, List[int], np.ndarray]] = None,
+    num_threads: int = 0,
+) -> np.ndarray:
+    """
+    FPS sampling of many clouds of different sizes, packed one after another into a single array.
+    Clouds are sampled in parallel with work stealing, so a few large clouds and many small ones still keep all cores busy.
+
+    Args:
+        pc (np.ndarray): The packed point clouds of shape (sum n_pts, D).
+        offsets (list[int] or np.ndarray): Cloud b is `pc[offsets[b]:offsets[b + 1]]`, of shape (n_batch + 1,).
+        n_samples (int or list[int] or np.ndarray): Number of samples of every cloud, of shape (n_batch,). An int is shared by all clouds.
+        method (str, default="fps"): One of "fps", "fps_kdtree", "npdu", "npdu_morton", "npdu_kdtree", "bucket_kdtree", "bucket_kdline".
+            "npdu_morton" is "npdu" with `reorder=True`, see `fps_npdu_sampling`.
+        w (int, default=None): Windows size of local heuristic search for the NPDU methods.
+            If set to None, it will be set to `n_pts / n_samples * 16` for each cloud.
+        h (int, default=None): Height of KDTree for "bucket_kdline". Required for that method.
+        start_idx (int or list[int] or np.ndarray, default=None): The starting index of every cloud, relative to the start of the cloud.
+            An int is shared by all clouds. If set to None, it will be randomly picked for each cloud.
+        num_threads (int, default=0): Number of threads. 0 uses all cores.
+    Returns:
+        np.ndarray: The selected rows of `pc`, cloud after cloud, of shape (sum n_samples,).
+            The samples of cloud b start at `np.cumsum(n_samples)[b - 1]`.
+    """
+    assert method in _RAGGED_METHODS, f"method should be one of {_RAGGED_METHODS}"
+    assert pc.ndim == 2
+    assert num_threads >= 0, "num_threads should be >= 0"
+    offsets = np.asarray(offsets, dtype=np.int64)
+    assert offsets.ndim == 1 and len(offsets) >= 1, "offsets should be of shape (n_batch + 1,)"
+    assert offsets[0] == 0 and offsets[-1] == pc.shape[0], "offsets should start at 0 and end at n_pts"
+    n_pts = np.diff(offsets)
+    assert np.all(n_pts >= 0), "offsets should be non-decreasing"
+    n_batch = len(n_pts)
+
+    n_samples = np.broadcast_to(np.asarray(n_samples, dtype=np.int64), (n_batch,))
+    assert np.all(n_samples >= 0), "n_samples should be >= 0"
+    assert np.all(n_pts >= n_samples), "n_pts should be >= n_samples for every cloud"
+
+    if start_idx is None:
+        start_idx = (np.random.rand(n_batch) * n_pts).astype(np.int64)
+    start_idx = np.broadcast_to(np.asarray(start_idx, dtype=np.int64), (n_batch,))
+    active = n_samples > 0
+    assert np.all((0 <= start_idx[active]) & (start_idx[active] < n_pts[active])), "start_idx should be 0 <= start_idx < n_pts"
+
+    params = np.zeros(n_batch, dtype=np.uint64)
+    if method in ("npdu", "npdu_morton", "npdu_kdtree"):
+        # a window may not exceed the cloud itself, see `fps_npdu_sampling`
+        limit = n_pts if method == "npdu_kdtree" else n_pts - 1
+        if w is None:
+            params = (n_pts / np.maximum(n_samples, 1) * 16).astype(np.int64)
+        else:
+            params = np.full(n_batch, w, dtype=np.int64)
+        params = np.minimum(params, np.maximum(limit, 0)).astype(np.uint64)
+    elif method == "bucket_kdline":
+        assert h is not None and h >= 1, "h should be >= 1"
+        assert np.all(2**h <= n_pts[active]), "2**h should be <= n_pts for every sampled cloud"
+        params = np.full(n_batch, h, dtype=np.uint64)
+
+    pc = np.ascontiguousarray(pc, dtype=np.float32)
+    return _ragged_sampling(
+        pc,
+        offsets.astype(np.uint64),
+        n_samples.astype(np.uint64),
+        start_idx.astype(np.uint64),
+        method,
+        params,
+        num_threads,
+    )
+
+
+class FPSSampler:
+    """
+    FPS state that can be extended on demand. FPS is prefix-stable, so asking for 1k, then 4k, then 16k samples
+    costs the same as asking for 16k once, and the result equals the one-shot sampling with the same start index.
+
+    Args:
+        pc (np.ndarray): The input point cloud of shape (n_pts, D).
+        method (str, default="fps"): One of "fps", "bucket_kdtree", "bucket_kdline".
+        h (int, default=None): Height of KDTree for "bucket_kdline". Required for that method.
+        start_idx (int, default=None): The starting index of sampling. If set to None, it will be randomly picked.
+        num_threads (int, default=1): Number of threads used for the distance update of "fps". 0 uses all cores.
+    """
+
+    def __init__(
+        self,
+        pc: np.ndarray,
+        method: str = "fps",
+        h: Optional[int] = None,
+        start_idx: Optional[int] = None,
+        num_threads: int = 1,
+    ):
+        assert method in ("fps", "bucket_kdtree", "bucket_kdline"), (
+            "method should be one of 'fps', 'bucket_kdtree', 'bucket_kdline'"
+        )
+        assert pc.ndim == 2
+        assert num_threads >= 0, "num_threads should be >= 0"
+        n_pts, _ = pc.shape
+        assert n_pts >= 1, "n_pts should be >= 1"
+        if method == "bucket_kdline":
+            assert h is not None and h >= 1, "h should be >= 1"
+            assert 2**h <= n_pts, "2**h should be <= n_pts"
+        assert start_idx is None or 0 <= start_idx < n_pts, "start_idx should be None or 0 <= start_idx < n_pts"
+        start_idx = get_start_idx(n_pts, start_idx)
+        self._impl = _FPSSampler(np.asarray(pc, dtype=np.float32), method, start_idx, h or 0, num_threads)
+        self._chunks: List[np.ndarray] = []
+
+    def next(self, k: int) -> np.ndarray:
+        """
+        Extend the selection by k more samples.
+
+        Args:
+            k (int): Number of samples to add.
+        Returns:
+            np.ndarray: The new indices of shape (k,), fewer once every point has been sampled.
+        """
+        assert k >= 0, "k should be >= 0"
+        idx = self._impl.next(k)
+        self._chunks.append(idx)
+        return idx
+
+    @property
+    def indices(self) -> np.ndarray:
+        """All indices selected so far, in sampling order."""
+        if len(self._chunks) != 1:
+            self._chunks = [np.concatenate(self._chunks or [np.empty(0, dtype=np.uint64)])]
+        return self._chunks[0]
+
+    def __len__(self) -> int:
+        return self._impl.size()
+
+
+def simd_isa() -> str:
+    """
+    Instruction set used by the vanilla FPS kernel, picked from CPUID at import time.
+
+    Returns:
+        str: One of "avx512", "avx2", "sse2" or "scalar".
+    """
+    return _simd_isa()
 
 
 __all__ = [
@@ -212,6 +827,19 @@ __all__ = [
     "fps_sampling",
     "fps_npdu_sampling",
     "fps_npdu_kdtree_sampling",
+    "fps_kdtree_sampling",
+    "knn_graph",
+    "fps_npdu_graph_sampling",
+    "mesh_graph",
+    "geodesic_fps_sampling",
     "bucket_fps_kdtree_sampling",
     "bucket_fps_kdline_sampling",
+    "fps_sampling_batch",
+    "fps_npdu_sampling_batch",
+    "fps_npdu_kdtree_sampling_batch",
+    "bucket_fps_kdtree_sampling_batch",
+    "bucket_fps_kdline_sampling_batch",
+    "ragged_sampling",
+    "FPSSampler",
+    "simd_isa",
 ]
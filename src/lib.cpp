@@ -1,6 +1,14 @@
 #include <pybind11/pybind11.h>
 #include <pybind11/numpy.h>
+#include <cmath>
+#include <functional>
+#include <mutex>
+#include <string>
+#include "max_tree.hpp"
+#include "morton.hpp"
 #include "nanoflann.hpp"
+#include "simd.hpp"
+#include "thread_pool.hpp"
 #include "wrapper.hpp"
 
 #if defined(_MSC_VER)
@@ -17,10 +25,14 @@ class StartIndex {
 public:
     enum Type { SINGLE, ARRAY } type;
     size_t single_idx;
-    py::array_t<size_t> array_idx;
+    py::array_t<size_t, py::array::c_style | py::array::forcecast> array_idx;
 
     StartIndex(size_t idx) : type(SINGLE), single_idx(idx) {}
     StartIndex(py::array_t<size_t> arr) : type(ARRAY), array_idx(arr) {}
+
+    // The start indices as one contiguous list, for the kernels
+    const size_t* data() const { return type == SINGLE ? &single_idx : array_idx.data(); }
+    size_t size() const { return type == SINGLE ? 1 : static_cast<size_t>(array_idx.shape(0)); }
 };
 
 struct PointCloud {
@@ -43,14 +55,37 @@ struct PointCloud {
         return data[idx * dim + dim_];
     }
 
+    // Per-dimension (min, max), filled in by compute_bbox(). Left empty,
+    // nanoflann computes the bounds itself through kdtree_get_pt.
+    std::vector<std::pair<float, float>> bbox;
+
+    // One row-major pass over the points.
+    void compute_bbox() {
+        bbox.assign(dim, {0.0f, 0.0f});
+        if (N == 0) return;
+        for (size_t j = 0; j < dim; ++j) bbox[j] = {data[j], data[j]};
+        for (size_t i = 1; i < N; ++i) {
+            const float* row = data + i * dim;
+            for (size_t j = 0; j < dim; ++j) {
+                if (row[j] < bbox[j].first) bbox[j].first = row[j];
+                if (row[j] > bbox[j].second) bbox[j].second = row[j];
+            }
+        }
+    }
+
     template <class BBOX>
-    bool kdtree_get_bbox(BBOX&) const {
-        return false;
+    bool kdtree_get_bbox(BBOX& bb) const {
+        if (bbox.empty()) return false;
+        for (size_t j = 0; j < dim; ++j) {
+            bb[j].low = bbox[j].first;
+            bb[j].high = bbox[j].second;
+        }
+        return true;
     }
 };
 
 void check_py_input(
-    py::array_t<float, py::array::c_style | py::array::forcecast> points,
+    const py::array& points,
     size_t n_samples,
     const StartIndex& start_idx,
     std::optional<size_t> max_dim = std::nullopt
@@ -108,148 +143,272 @@ void check_py_input(
     }
 }
 
-py::array_t<size_t>
-fps_sampling_multi_start_index(
-    py::array_t<float, py::array::c_style | py::array::forcecast> points,
-    size_t n_samples,
-    py::array_t<size_t, py::array::c_style | py::array::forcecast> start_idx)
-{
-    auto pts = points.unchecked<2>();   // 2D view
-    auto starts = start_idx.unchecked<1>();
+// Below this many points per thread the per-iteration barrier costs more
+// than the distance update it parallelizes.
+constexpr size_t kMinPointsPerThread = 16384;
+
+// Optional by-products of a sampling run, as squared distances. `radii[s]`
+// is the distance of sample s to the samples picked before it, at the time it
+// was picked (inf for the first sample). `dist_min[i]` is the final distance
+// of point i to the whole sample set. Null pointers are not written.
+struct SampleStats {
+    float* radii = nullptr;
+    float* dist_min = nullptr;
+};
 
-    ssize_t P = pts.shape(0);
-    ssize_t C = pts.shape(1);
+// First `n` entries of a 1D array, copied out when the array is longer.
+template <typename T>
+py::array_t<T> truncated(const py::array_t<T>& arr, size_t n) {
+    if (static_cast<size_t>(arr.shape(0)) == n) return arr;
+    py::array_t<T> out(static_cast<ssize_t>(n));
+    std::copy(arr.data(), arr.data() + n, out.mutable_data());
+    return out;
+}
 
-    if (P <= 0 || C <= 0) {
-        throw std::runtime_error("points must be a 2D array");
+// A 1D array holding a copy of `values`.
+template <typename T>
+py::array_t<T> to_array(const std::vector<T>& values) {
+    py::array_t<T> out(static_cast<ssize_t>(values.size()));
+    std::copy(values.begin(), values.end(), out.mutable_data());
+    return out;
+}
+
+// Arrays behind the SampleStats of one Python call, allocated only when the
+// caller asked for them.
+struct StatsOutput {
+    py::object radii = py::none();
+    py::object dist_min = py::none();
+    SampleStats stats;
+
+    StatsOutput(bool return_radii, bool return_dist_min, size_t n_samples, size_t P) {
+        if (return_radii) {
+            py::array_t<float> arr(static_cast<ssize_t>(n_samples));
+            stats.radii = arr.mutable_data();
+            radii = arr;
+        }
+        if (return_dist_min) {
+            py::array_t<float> arr(static_cast<ssize_t>(P));
+            stats.dist_min = arr.mutable_data();
+            dist_min = arr;
+        }
     }
 
-    size_t res_selected_idx = 0;
-    bool has_prev = false;
+    // `indices` alone when nothing else was requested, otherwise
+    // (indices, radii, dist_min) with None for the outputs not requested.
+    // radii is cut to the number of samples actually taken.
+    py::object result(const py::array_t<size_t>& indices) const {
+        if (!stats.radii && !stats.dist_min) return indices;
+        py::object r = radii;
+        if (stats.radii)
+            r = truncated(radii.cast<py::array_t<float>>(), static_cast<size_t>(indices.shape(0)));
+        return py::make_tuple(indices, r, dist_min);
+    }
+};
 
-    std::vector<float> dist_min(P, std::numeric_limits<float>::infinity());
-    std::vector<size_t> selected;
-    selected.reserve(n_samples);
+// Rows idx[0..m) of `pts`, packed row-major (m x C).
+std::vector<float> gather_rows(const simd::CloudView& pts, const size_t* idx, size_t m) {
+    std::vector<float> rows(m * pts.C);
+    for (size_t r = 0; r < m; ++r)
+        for (size_t j = 0; j < pts.C; ++j) rows[r * pts.C + j] = pts.at(idx[r], j);
+    return rows;
+}
 
-    size_t start_counter = 0;
+// Fused dist_min refresh + argmax of vanilla FPS against one sample at a
+// time. With num_threads > 1 the points are split across a worker pool that
+// lives as long as this object; partial argmaxes are merged with the serial
+// tie-breaking, so the result does not depend on num_threads.
+class FpsRefresher {
+public:
+    FpsRefresher(const simd::CloudView& pts, float* dist_min, size_t num_threads)
+        : pts_(pts), dist_min_(dist_min), ref_(pts.C),
+          n_threads_(threading::resolve_num_threads(num_threads, pts.P, kMinPointsPerThread)) {
+        if (n_threads_ > 1) {
+            pool_.reset(new threading::WorkerPool(n_threads_));
+            partial_.resize(n_threads_);
+        }
+    }
 
-    while (selected.size() < n_samples) {
-        if (has_prev) {
-            size_t i0 = res_selected_idx;
+    simd::ArgMax operator()(size_t last) {
+        for (size_t j = 0; j < pts_.C; ++j) ref_[j] = pts_.at(last, j);
+        if (!pool_)
+            return simd::update_argmax(pts_, 0, pts_.P, ref_.data(), dist_min_);
+        pool_->run([&](size_t tid) {
+            auto range = threading::split_range(pts_.P, n_threads_, tid, 16);
+            partial_[tid].best = simd::update_argmax(
+                pts_, range.first, range.second, ref_.data(), dist_min_);
+        });
+        simd::ArgMax best = partial_[0].best;
+        for (size_t tid = 1; tid < n_threads_; ++tid) best = simd::merge(best, partial_[tid].best);
+        return best;
+    }
 
-            for (ssize_t i = 0; i < P; i++) {
-                float dist = 0.0f;
-                for (ssize_t j = 0; j < C; j++) {
-                    float d = pts(i, j) - pts(i0, j);
-                    dist += d * d;
-                }
-                if (dist < dist_min[i]) {
-                    dist_min[i] = dist;
-                }
-            }
+    // Fold the points idx[0..m) into dist_min in one pass over the cloud,
+    // with the same result as calling operator() on each of them.
+    void seed(const size_t* idx, size_t m) {
+        if (m == 0) return;
+        std::vector<float> refs = gather_rows(pts_, idx, m);
+        if (!pool_) {
+            simd::update_min(pts_, 0, pts_.P, refs.data(), m, dist_min_);
+            return;
+        }
+        pool_->run([&](size_t tid) {
+            auto range = threading::split_range(pts_.P, n_threads_, tid, 16);
+            simd::update_min(pts_, range.first, range.second, refs.data(), m, dist_min_);
+        });
+    }
 
-            if (start_counter < (size_t) starts.shape(0)) {
-                size_t idx = starts(start_counter);
-                selected.push_back(idx);
-                res_selected_idx = idx;
-                start_counter++;
-            } else {
-                size_t max_idx = 0;
-                float max_val = -1.0f;
-
-                for (ssize_t i = 0; i < P; i++) {
-                    if (dist_min[i] >= max_val) {
-                        max_val = dist_min[i];
-                        max_idx = i;
-                    }
-                }
+private:
+    struct alignas(64) Partial { simd::ArgMax best; };
 
-                selected.push_back(max_idx);
-                res_selected_idx = max_idx;
-            }
+    simd::CloudView pts_;
+    float* dist_min_;
+    std::vector<float> ref_;
+    size_t n_threads_;
+    std::unique_ptr<threading::WorkerPool> pool_;
+    std::vector<Partial> partial_;
+};
 
-        } else {
-            size_t idx = starts(start_counter);
-            selected.push_back(idx);
-            res_selected_idx = idx;
-            start_counter++;
-            has_prev = true;
+// Vanilla FPS on `pts`, writing n_samples indices to `out`. The first picks
+// are taken from `starts` (n_starts >= 1); the remaining ones are farthest
+// points, see FpsRefresher for the threading. All starts but the last are
+// folded into dist_min in a single pass, and the last one is fused with the
+// first argmax, so m seeds cost about one pass over the cloud instead of m.
+// Sampling stops early once every point is closer than sqrt(stop_dist2) to a
+// sample; the number of samples taken is returned.
+size_t fps_sampling_kernel(
+    const simd::CloudView& pts,
+    size_t n_samples,
+    const size_t* starts, size_t n_starts,
+    size_t num_threads,
+    size_t* out,
+    const SampleStats& stats = {},
+    float stop_dist2 = 0.0f
+) {
+    if (n_samples == 0) return 0;
+
+    const size_t P = pts.P;
+    const size_t m = std::min(n_starts, n_samples);
+    const float inf = std::numeric_limits<float>::infinity();
+    std::copy(starts, starts + m, out);
+    if (stats.radii) {
+        // distance of each start to the ones before it, from the starts alone
+        std::vector<float> seeds = gather_rows(pts, starts, m);
+        simd::CloudView seed_view{seeds.data(), m, pts.C, pts.C, simd::Layout::AoS};
+        for (size_t s = 0; s < m; ++s) {
+            stats.radii[s] = inf;
+            simd::update_min(seed_view, s, s + 1, seeds.data(), s, stats.radii);
         }
     }
+    if (m == n_samples && !stats.dist_min) return m;
 
-    py::array_t<size_t> out(selected.size());
-    auto out_buf = out.mutable_unchecked<1>();
-    for (size_t i = 0; i < selected.size(); i++) {
-        out_buf(i) = selected[i];
+    // the caller's dist_min output doubles as the working buffer
+    std::vector<float> dist_buf;
+    float* dist_min = stats.dist_min;
+    if (dist_min) {
+        std::fill(dist_min, dist_min + P, inf);
+    } else {
+        dist_buf.assign(P, inf);
+        dist_min = dist_buf.data();
     }
-    return out;
+
+    FpsRefresher refresh(pts, dist_min, num_threads);
+    refresh.seed(out, m - 1);
+    size_t s = m;
+    for (; s < n_samples; ++s) {
+        simd::ArgMax best = refresh(out[s - 1]);
+        if (best.val < stop_dist2) break;
+        out[s] = best.idx;
+        if (stats.radii) stats.radii[s] = dist_min[out[s]];
+    }
+    // unless sampling stopped early, the last sample has not been folded
+    // into dist_min yet
+    if (stats.dist_min && s == n_samples) refresh(out[n_samples - 1]);
+    return s;
+}
+
+// View `points` in place when one of its axes is unit-stride: C-ordered and
+// Fortran-ordered arrays, and column/row slices of them. Anything else is
+// copied into a C-ordered array that `holder` keeps alive.
+simd::CloudView make_cloud_view(const py::array_t<float, py::array::forcecast>& points, py::object& holder) {
+    const ssize_t P = points.shape(0);
+    const ssize_t C = points.shape(1);
+    const ssize_t item = static_cast<ssize_t>(sizeof(float));
+    const ssize_t s0 = points.strides(0);
+    const ssize_t s1 = points.strides(1);
+    const float* data = points.data();
+
+    if ((s1 == item || C == 1) && s0 > 0 && s0 % item == 0 && s0 / item >= C)
+        return {data, size_t(P), size_t(C), size_t(s0 / item), simd::Layout::AoS};
+    if ((s0 == item || P == 1) && s1 > 0 && s1 % item == 0 && s1 / item >= P)
+        return {data, size_t(P), size_t(C), size_t(s1 / item), simd::Layout::SoA};
+
+    auto contiguous = py::array_t<float, py::array::c_style | py::array::forcecast>::ensure(points);
+    holder = contiguous;
+    return {contiguous.data(), size_t(P), size_t(C), size_t(C), simd::Layout::AoS};
+}
+
+py::array_t<size_t>
+fps_sampling_multi_start_index(
+    const simd::CloudView& pts,
+    size_t n_samples,
+    py::array_t<size_t, py::array::c_style | py::array::forcecast> start_idx,
+    size_t num_threads,
+    const SampleStats& stats = {},
+    float stop_dist2 = 0.0f)
+{
+    if (pts.P == 0 || pts.C == 0) {
+        throw std::runtime_error("points must be a 2D array");
+    }
+    if (n_samples > 0 && start_idx.shape(0) == 0) {
+        throw py::value_error("start_idx must contain at least one index");
+    }
+
+    py::array_t<size_t> out(n_samples);
+    size_t* out_ptr = out.mutable_data();
+    const size_t* starts = start_idx.data();
+    const size_t n_starts = static_cast<size_t>(start_idx.shape(0));
+    size_t n_taken;
+    {
+        py::gil_scoped_release release;
+        n_taken = fps_sampling_kernel(pts, n_samples, starts, n_starts, num_threads, out_ptr, stats, stop_dist2);
+    }
+    return truncated(out, n_taken);
 }
 
 py::array_t<size_t> fps_sampling(
-    py::array_t<float, py::array::c_style | py::array::forcecast> points,
+    const simd::CloudView& pts,
     size_t n_samples,
-    size_t start_idx
+    size_t start_idx,
+    size_t num_threads,
+    const SampleStats& stats = {},
+    float stop_dist2 = 0.0f
 ) {
-    auto pts = points.unchecked<2>();
-    ssize_t P = pts.shape(0);
-    ssize_t C = pts.shape(1);
-
-    if (P <= 0 || C <= 0) {
+    if (pts.P == 0 || pts.C == 0) {
         throw py::value_error("points must be a 2D array with at least one column");
     }
-    if (start_idx >= static_cast<size_t>(P)) {
+    if (start_idx >= pts.P) {
         throw py::value_error("start_idx out of range");
     }
 
-    size_t res_selected_idx = start_idx;
-    bool has_prev = false;
-    std::vector<float> dist_min(P, std::numeric_limits<float>::infinity());
-
-    std::vector<size_t> selected;
-    selected.reserve(n_samples);
-
-    while (selected.size() < n_samples) {
-        if (has_prev) {
-            size_t i0 = res_selected_idx;
-            for (ssize_t i = 0; i < P; ++i) {
-                float dist = 0.0f;
-                for (ssize_t j = 0; j < C; ++j) {
-                    float d = pts(i, j) - pts(i0, j);
-                    dist += d * d;
-                }
-                if (dist < dist_min[i]) dist_min[i] = dist;
-            }
-
-            size_t max_idx = 0;
-            float max_val = -1.0f;
-            for (ssize_t i = 0; i < P; ++i) {
-                if (dist_min[i] >= max_val) {
-                    max_val = dist_min[i];
-                    max_idx = i;
-                }
-            }
-            selected.push_back(max_idx);
-            res_selected_idx = max_idx;
-        } else {
-            selected.push_back(start_idx);
-            res_selected_idx = start_idx;
-            has_prev = true;
-        }
-    }
-
-    py::array_t<size_t> out(selected.size());
-    auto out_buf = out.mutable_unchecked<1>();
-    for (size_t i = 0; i < selected.size(); ++i) {
-        out_buf(i) = selected[i];
+    py::array_t<size_t> out(n_samples);
+    size_t* out_ptr = out.mutable_data();
+    size_t n_taken;
+    {
+        py::gil_scoped_release release;
+        n_taken = fps_sampling_kernel(pts, n_samples, &start_idx, 1, num_threads, out_ptr, stats, stop_dist2);
     }
-    return out;
+    return truncated(out, n_taken);
 }
 
 // EXPORT TO _fps_sample
-py::array_t<size_t> _fps_sampling(
-    py::array_t<float, py::array::c_style | py::array::forcecast> points,
+py::object _fps_sampling(
+    py::array_t<float, py::array::forcecast> points,
     size_t n_samples,
-    py::object start_idx_obj
+    py::object start_idx_obj,
+    size_t num_threads,
+    bool return_radii,
+    bool return_dist_min,
+    float radius
 ) {
     StartIndex start_idx = [&]() -> StartIndex {
         if (py::isinstance<py::int_>(start_idx_obj)) {
@@ -263,88 +422,565 @@ py::array_t<size_t> _fps_sampling(
 
     check_py_input(points, n_samples, start_idx, std::nullopt);
 
+    // C- and Fortran-ordered inputs are read in place by their own kernels
+    py::object holder;
+    simd::CloudView pts = make_cloud_view(points, holder);
+
+    StatsOutput extra(return_radii, return_dist_min, n_samples, pts.P);
+    const float stop_dist2 = radius * radius;
     if (start_idx.type == StartIndex::SINGLE)
-        return fps_sampling(points, n_samples, start_idx.single_idx);
+        return extra.result(fps_sampling(pts, n_samples, start_idx.single_idx, num_threads, extra.stats, stop_dist2));
     else
-        return fps_sampling_multi_start_index(points, n_samples, start_idx.array_idx);
+        return extra.result(fps_sampling_multi_start_index(pts, n_samples, start_idx.array_idx, num_threads, extra.stats, stop_dist2));
+}
+
+// Squared distance between two C-dimensional points. DIM > 0 fixes C at
+// compile time so the loop is fully unrolled; DIM == 0 reads C at runtime.
+template <size_t DIM>
+inline float squared_distance(const float* a, const float* b, size_t C) {
+    const size_t D = DIM ? DIM : C;
+    float dist = 0.0f;
+    for (size_t j = 0; j < D; ++j) {
+        float d = a[j] - b[j];
+        dist += d * d;
+    }
+    return dist;
+}
+
+// NPDU on a row-major P x C buffer: after the first full pass only the k/2
+// index neighbours on either side of each new sample are refreshed, and a
+// MaxTree over dist_min gives the next sample without a full scan.
+template <size_t DIM>
+void fps_npdu_kernel(
+    const float* data, size_t P, size_t C,
+    size_t n_samples, size_t k,
+    const size_t* starts, size_t n_starts,
+    size_t* out,
+    const SampleStats& stats = {}
+) {
+    if (n_samples == 0) return;
+    n_starts = std::min(n_starts, n_samples);
+
+    const float inf = std::numeric_limits<float>::infinity();
+    std::vector<float> dist_buf;
+    float* dist_min = stats.dist_min;
+    if (dist_min) {
+        std::fill(dist_min, dist_min + P, inf);
+    } else {
+        dist_buf.assign(P, inf);
+        dist_min = dist_buf.data();
+    }
+    // the seeds get exact distances with a full pass each
+    const float* ref;
+    for (size_t s = 0; s < n_starts; ++s) {
+        out[s] = starts[s];
+        if (stats.radii) stats.radii[s] = dist_min[starts[s]];
+        ref = data + starts[s] * C;
+        for (size_t i = 0; i < P; ++i) {
+            float dist = squared_distance<DIM>(data + i * C, ref, C);
+            if (dist < dist_min[i]) dist_min[i] = dist;
+        }
+    }
+
+    const ssize_t SP = static_cast<ssize_t>(P);
+    const ssize_t hw = static_cast<ssize_t>(k / 2);
+    // refresh dist_min in the index window around the sample `last`
+    auto refresh_window = [&](size_t last) {
+        ssize_t start = static_cast<ssize_t>(last) - hw;
+        ssize_t end   = static_cast<ssize_t>(last) + hw;
+        if (start < 0) { end -= start; start = 0; }
+        if (end >= SP) { start = std::max(start - (end - SP + 1), ssize_t(0)); end = SP - 1; }
+
+        ref = data + last * C;
+        for (ssize_t i = start; i <= end; ++i) {
+            float dist = squared_distance<DIM>(data + i * C, ref, C);
+            if (dist < dist_min[i]) dist_min[i] = dist;
+        }
+        return std::make_pair(static_cast<size_t>(start), static_cast<size_t>(end) + 1);
+    };
+
+    if (n_starts == n_samples) return;
+    MaxTree max_tree(dist_min, P);
+    for (size_t s = n_starts; s < n_samples; ++s) {
+        if (s > n_starts) {
+            auto range = refresh_window(out[s - 1]);
+            max_tree.update_range(range.first, range.second);
+        }
+        out[s] = max_tree.argmax();
+        if (stats.radii) stats.radii[s] = max_tree.max();
+    }
+    if (stats.dist_min) refresh_window(out[n_samples - 1]);
+}
+
+using NpduFuncType = void (*)(const float*, size_t, size_t, size_t, size_t, const size_t*, size_t, size_t*, const SampleStats&);
+
+// fps_npdu_kernel on a copy of the cloud sorted along a Morton curve, so the
+// index window holds spatial neighbours even when the input order is
+// arbitrary. Starts, samples and dist_min are in the caller's order.
+template <size_t DIM>
+void fps_npdu_morton_kernel(
+    const float* data, size_t P, size_t C,
+    size_t n_samples, size_t k,
+    const size_t* starts, size_t n_starts,
+    size_t* out,
+    const SampleStats& stats = {}
+) {
+    if (n_samples == 0) return;
+    n_starts = std::min(n_starts, n_samples);
+
+    const std::vector<size_t> order = morton::order(data, P, C);
+    std::vector<size_t> rank(P);
+    std::vector<float> sorted(P * C);
+    for (size_t r = 0; r < P; ++r) {
+        rank[order[r]] = r;
+        std::copy(data + order[r] * C, data + (order[r] + 1) * C, sorted.data() + r * C);
+    }
+    std::vector<size_t> sorted_starts(n_starts);
+    for (size_t s = 0; s < n_starts; ++s) sorted_starts[s] = rank[starts[s]];
+
+    std::vector<float> sorted_dist;
+    SampleStats sorted_stats{stats.radii, nullptr};
+    if (stats.dist_min) {
+        sorted_dist.resize(P);
+        sorted_stats.dist_min = sorted_dist.data();
+    }
+    fps_npdu_kernel<DIM>(sorted.data(), P, C, n_samples, k,
+                         sorted_starts.data(), n_starts, out, sorted_stats);
+
+    for (size_t s = 0; s < n_samples; ++s) out[s] = order[out[s]];
+    if (stats.dist_min)
+        for (size_t r = 0; r < P; ++r) stats.dist_min[order[r]] = sorted_dist[r];
+}
+
+template <bool Reorder> struct npdu_func_helper {
+    template <size_t DIM> NpduFuncType operator()() {
+        return Reorder ? &fps_npdu_morton_kernel<DIM> : &fps_npdu_kernel<DIM>;
+    }
+};
+
+// Same dispatch as the bucket engines: one fully unrolled kernel per
+// dimension up to simd::kMaxFixedDim, plus the generic fallback. With
+// `reorder` the cloud is Morton-sorted first, see fps_npdu_morton_kernel.
+NpduFuncType npdu_kernel_for(size_t C, bool reorder = false) {
+    static const auto func_arr = map<NpduFuncType, simd::kMaxFixedDim>(npdu_func_helper<false>{});
+    static const auto morton_arr = map<NpduFuncType, simd::kMaxFixedDim>(npdu_func_helper<true>{});
+    if (C >= 1 && C <= simd::kMaxFixedDim) return reorder ? morton_arr[C - 1] : func_arr[C - 1];
+    return reorder ? &fps_npdu_morton_kernel<0> : &fps_npdu_kernel<0>;
 }
 
 py::array_t<size_t> fps_npdu_sampling(
     py::array_t<float, py::array::c_style | py::array::forcecast> points,
     size_t n_samples,
     size_t k,
-    size_t start_idx
+    const StartIndex& start_idx,
+    const SampleStats& stats = {},
+    bool reorder = false
 ) {
-    auto pts = points.unchecked<2>();
-    ssize_t P = pts.shape(0);
-    ssize_t C = pts.shape(1);
+    ssize_t P = points.shape(0);
+    ssize_t C = points.shape(1);
 
     if (P <= 0 || C <= 0)
         throw py::value_error("points must be a 2D array with at least one column");
-    if (start_idx >= static_cast<size_t>(P))
-        throw py::value_error("start_idx out of range");
+    if (n_samples > 0 && start_idx.size() == 0)
+        throw py::value_error("start_idx must contain at least one index");
 
-    std::vector<float> dist_min(P, std::numeric_limits<float>::infinity());
-    std::vector<size_t> selected;
-    selected.reserve(n_samples);
-
-    size_t res_selected_idx = start_idx;
-    bool has_prev = false;
-
-    while (selected.size() < n_samples) {
-        if (has_prev) {
-            ssize_t hw = static_cast<ssize_t>(k / 2);
-            ssize_t start = static_cast<ssize_t>(res_selected_idx) - hw;
-            ssize_t end   = static_cast<ssize_t>(res_selected_idx) + hw;
-            if (start < 0) { end -= start; start = 0; }
-            if (end >= P) { start = std::max(start - (end - P + 1), ssize_t(0)); end = P - 1; }
-
-            for (ssize_t i = start; i <= end; ++i) {
-                float dist = 0.0f;
-                for (ssize_t j = 0; j < C; ++j) {
-                    float d = pts(i, j) - pts(res_selected_idx, j);
-                    dist += d*d;
-                }
-                if (dist < dist_min[i]) dist_min[i] = dist;
+    py::array_t<size_t> out(n_samples);
+    size_t* out_ptr = out.mutable_data();
+    NpduFuncType kernel = npdu_kernel_for(static_cast<size_t>(C), reorder);
+    {
+        py::gil_scoped_release release;
+        kernel(points.data(), static_cast<size_t>(P), static_cast<size_t>(C),
+               n_samples, k, start_idx.data(), start_idx.size(), out_ptr, stats);
+    }
+    return out;
+}
+
+// EXPORT TO _fps_npdu_sample
+py::object fps_npdu_sampling_py(
+    py::array_t<float, py::array::c_style | py::array::forcecast> points,
+    size_t n_samples,
+    size_t k,
+    py::object start_idx_obj,
+    bool return_radii,
+    bool return_dist_min,
+    bool reorder
+) {
+    StartIndex start_idx = [&]() -> StartIndex {
+        if (py::isinstance<py::int_>(start_idx_obj))
+            return StartIndex(start_idx_obj.cast<size_t>());
+        else if (py::isinstance<py::array_t<size_t>>(start_idx_obj))
+            return StartIndex(start_idx_obj.cast<py::array_t<size_t>>());
+        else
+            throw py::type_error("start_idx must be int or 1D numpy array of size_t");
+    }();
+
+    check_py_input(points, n_samples, start_idx);
+
+    StatsOutput extra(return_radii, return_dist_min, n_samples, static_cast<size_t>(points.shape(0)));
+    return extra.result(fps_npdu_sampling(points, n_samples, k, start_idx, extra.stats, reorder));
+}
+
+// NPDU loop shared by the neighbourhood engines. The seeds get exact
+// distances with a full pass each; after that only the neighbourhood of each
+// new sample is refreshed, `for_each_neighbour(last, f)` calling f(nb, dist2)
+// for every neighbour nb of `last` at squared distance dist2. A MaxTree over
+// dist_min gives the next sample without a full scan.
+template <typename ForEachNeighbour>
+void npdu_neighbourhood_loop(
+    const float* data, size_t P, size_t C,
+    size_t n_samples,
+    const size_t* starts, size_t n_starts,
+    size_t* out,
+    const SampleStats& stats,
+    ForEachNeighbour&& for_each_neighbour
+) {
+    const float inf = std::numeric_limits<float>::infinity();
+    std::vector<float> dist_buf;
+    float* dist_min = stats.dist_min;
+    if (dist_min) {
+        std::fill(dist_min, dist_min + P, inf);
+    } else {
+        dist_buf.assign(P, inf);
+        dist_min = dist_buf.data();
+    }
+
+    const simd::CloudView view{data, P, C, C, simd::Layout::AoS};
+    for (size_t s = 0; s < n_starts; ++s) {
+        out[s] = starts[s];
+        if (stats.radii) stats.radii[s] = dist_min[starts[s]];
+        simd::update_min(view, 0, P, data + starts[s] * C, 1, dist_min);
+    }
+    if (n_samples == n_starts) return;
+
+    MaxTree max_tree(dist_min, P);
+    auto refresh = [&](size_t last) {
+        for_each_neighbour(last, [&](size_t nb, float dist) {
+            if (dist < dist_min[nb]) {
+                dist_min[nb] = dist;
+                max_tree.update(nb);
             }
+        });
+    };
+    for (size_t s = n_starts; s < n_samples; ++s) {
+        refresh(out[s - 1]);
+        out[s] = max_tree.argmax();
+        if (stats.radii) stats.radii[s] = max_tree.max();
+    }
+    if (stats.dist_min) refresh(out[n_samples - 1]);
+}
+
+using KDTreeIndex = nanoflann::KDTreeSingleIndexAdaptor<nanoflann::L2_Simple_Adaptor<float, PointCloud>, PointCloud, -1>;
+
+// nanoflann index over `cloud`, built on up to `num_threads` threads with
+// `leaf_size` points per leaf. Small clouds are built serially.
+std::unique_ptr<KDTreeIndex> build_kdtree_index(const PointCloud& cloud, size_t leaf_size, size_t num_threads) {
+    const size_t build_threads = threading::resolve_num_threads(num_threads, cloud.N, kMinPointsPerThread);
+    return std::unique_ptr<KDTreeIndex>(new KDTreeIndex(
+        static_cast<int>(cloud.dim), cloud,
+        nanoflann::KDTreeSingleIndexAdaptorParams(
+            leaf_size, nanoflann::KDTreeSingleIndexAdaptorFlags::None,
+            static_cast<unsigned int>(build_threads))));
+}
 
-            size_t max_idx = 0;
-            float max_val = -1.0f;
-            for (ssize_t i = 0; i < P; ++i) {
-                if (dist_min[i] > max_val) { max_val = dist_min[i]; max_idx = i; }
+// NPDU where the refreshed neighbourhood of each new sample is its k nearest
+// neighbours from a nanoflann index instead of an index window. The index is
+// built on up to `num_threads` threads with `leaf_size` points per leaf; the
+// sampling loop itself does not allocate.
+void fps_npdu_kdtree_kernel(
+    const float* data, size_t P, size_t C,
+    size_t n_samples, size_t k,
+    const size_t* starts, size_t n_starts,
+    size_t* out,
+    const SampleStats& stats = {},
+    size_t leaf_size = 10,
+    size_t num_threads = 1
+) {
+    if (n_samples == 0) return;
+    n_starts = std::min(n_starts, n_samples);
+
+    PointCloud cloud;
+    cloud.N = P;
+    cloud.dim = C;
+    cloud.data = data;
+    cloud.compute_bbox();
+    const auto index = build_kdtree_index(cloud, leaf_size, num_threads);
+
+    const size_t k_use = std::min<size_t>(k, P);
+    std::vector<size_t> ret_indexes(k_use);
+    std::vector<float> out_dists(k_use);
+    const nanoflann::SearchParameters params;
+
+    // the squared distances nanoflann returns are the ones a direct loop
+    // would compute
+    npdu_neighbourhood_loop(data, P, C, n_samples, starts, n_starts, out, stats,
+        [&](size_t last, auto&& visit) {
+            nanoflann::KNNResultSet<float> resultSet(k_use);
+            resultSet.init(ret_indexes.data(), out_dists.data());
+            index->findNeighbors(resultSet, data + last * C, params);
+            for (size_t i = 0, n_found = resultSet.size(); i < n_found; ++i)
+                visit(ret_indexes[i], out_dists[i]);
+        });
+}
+
+// Non-owning CSR adjacency over P points: the neighbours of point i are
+// indices[indptr[i] .. indptr[i + 1]).
+struct CsrGraph {
+    size_t P;
+    const uint64_t* indptr;
+    const uint32_t* indices;
+};
+
+// All-points kNN graph of a row-major P x C buffer, in CSR form with
+// min(k, P) neighbours per point: the nanoflann neighbours of each point,
+// itself included, nearest first. `dists` gets the squared distances. Both
+// the index build and the queries use up to `num_threads` threads.
+void build_knn_graph(
+    const float* data, size_t P, size_t C, size_t k,
+    size_t leaf_size, size_t num_threads,
+    uint64_t* indptr, uint32_t* indices, float* dists
+) {
+    const size_t k_use = std::min<size_t>(k, P);
+    for (size_t i = 0; i <= P; ++i) indptr[i] = i * k_use;
+    if (P == 0 || k_use == 0) return;
+
+    PointCloud cloud;
+    cloud.N = P;
+    cloud.dim = C;
+    cloud.data = data;
+    cloud.compute_bbox();
+    const auto index = build_kdtree_index(cloud, leaf_size, num_threads);
+
+    constexpr size_t kChunk = 1024;
+    const size_t n_chunks = (P + kChunk - 1) / kChunk;
+    const nanoflann::SearchParameters params;
+    threading::parallel_for_dynamic(
+        n_chunks, threading::resolve_num_threads(num_threads, n_chunks),
+        [&](size_t chunk) {
+            const size_t end = std::min(P, (chunk + 1) * kChunk);
+            for (size_t i = chunk * kChunk; i < end; ++i) {
+                nanoflann::KNNResultSet<float, uint32_t> resultSet(k_use);
+                resultSet.init(indices + i * k_use, dists + i * k_use);
+                index->findNeighbors(resultSet, data + i * C, params);
             }
-            selected.push_back(max_idx);
-            res_selected_idx = max_idx;
+        });
+}
 
-        } else {
-            for (ssize_t i = 0; i < P; ++i) {
-                float dist = 0.0f;
-                for (ssize_t j = 0; j < C; ++j) {
-                    float d = pts(i,j) - pts(start_idx,j);
-                    dist += d*d;
+// NPDU on a precomputed neighbourhood graph: each new sample refreshes the
+// points adjacent to it. On a graph from build_knn_graph with the same k and
+// leaf size this gives the samples of fps_npdu_kdtree_kernel, without any
+// tree query in the loop.
+void fps_npdu_graph_kernel(
+    const float* data, size_t P, size_t C,
+    const CsrGraph& graph,
+    size_t n_samples,
+    const size_t* starts, size_t n_starts,
+    size_t* out,
+    const SampleStats& stats = {}
+) {
+    if (n_samples == 0) return;
+    n_starts = std::min(n_starts, n_samples);
+    npdu_neighbourhood_loop(data, P, C, n_samples, starts, n_starts, out, stats,
+        [&](size_t last, auto&& visit) {
+            const float* ref = data + last * C;
+            for (uint64_t e = graph.indptr[last]; e < graph.indptr[last + 1]; ++e) {
+                const size_t nb = graph.indices[e];
+                visit(nb, squared_distance<0>(ref, data + nb * C, C));
+            }
+        });
+}
+
+// Euclidean length of every edge of `graph` over a row-major P x C cloud.
+std::vector<float> edge_lengths(const float* data, size_t C, const CsrGraph& graph) {
+    std::vector<float> lengths(graph.indptr[graph.P]);
+    for (size_t i = 0; i < graph.P; ++i)
+        for (uint64_t e = graph.indptr[i]; e < graph.indptr[i + 1]; ++e)
+            lengths[e] = std::sqrt(squared_distance<0>(data + i * C, data + graph.indices[e] * C, C));
+    return lengths;
+}
+
+// Undirected edges of a triangle mesh in CSR form, each listed from both
+// ends once, neighbours in increasing order.
+void mesh_edges(const uint32_t* faces, size_t F, size_t P,
+                std::vector<uint64_t>& indptr, std::vector<uint32_t>& indices) {
+    indptr.assign(P + 1, 0);
+    for (size_t f = 0; f < 3 * F; ++f) indptr[faces[f] + 1] += 2;
+    for (size_t i = 0; i < P; ++i) indptr[i + 1] += indptr[i];
+    std::vector<uint64_t> fill(indptr.begin(), indptr.end() - 1);
+    indices.resize(indptr[P]);
+    for (size_t f = 0; f < F; ++f) {
+        const uint32_t* tri = faces + 3 * f;
+        for (size_t c = 0; c < 3; ++c) {
+            const uint32_t a = tri[c], b = tri[(c + 1) % 3];
+            indices[fill[a]++] = b;
+            indices[fill[b]++] = a;
+        }
+    }
+    // drop the copies of edges shared by several faces
+    uint64_t write = 0;
+    for (size_t i = 0; i < P; ++i) {
+        const uint64_t begin = indptr[i], end = indptr[i + 1];
+        std::sort(indices.begin() + begin, indices.begin() + end);
+        indptr[i] = write;
+        for (uint64_t e = begin; e < end; ++e) {
+            if (indices[e] == i) continue;
+            if (e > begin && indices[e] == indices[e - 1]) continue;
+            indices[write++] = indices[e];
+        }
+    }
+    indptr[P] = write;
+    indices.resize(write);
+}
+
+// Geodesic FPS on a weighted graph: dist_min is the shortest-path distance
+// to the samples along the edges, stored as-is (not squared). Each new
+// sample runs a Dijkstra that only expands a vertex while it improves that
+// vertex's dist_min. A path that reaches u no closer than dist_min[u] cannot
+// improve anything beyond u either, so the search stays within the region the
+// sample actually claims and late iterations are cheap. dist_min doubles as
+// the tentative distances, with stale heap entries skipped. Vertices not
+// connected to any sample stay at inf and are picked first, so every
+// component gets a sample. Ties go to the first index.
+void geodesic_fps_kernel(
+    const CsrGraph& graph, const float* weights,
+    size_t n_samples,
+    const size_t* starts, size_t n_starts,
+    size_t* out,
+    const SampleStats& stats = {}
+) {
+    if (n_samples == 0) return;
+    n_starts = std::min(n_starts, n_samples);
+    const size_t P = graph.P;
+
+    const float inf = std::numeric_limits<float>::infinity();
+    std::vector<float> dist_buf;
+    float* dist_min = stats.dist_min;
+    if (dist_min) {
+        std::fill(dist_min, dist_min + P, inf);
+    } else {
+        dist_buf.assign(P, inf);
+        dist_min = dist_buf.data();
+    }
+
+    MaxTree max_tree(dist_min, P);
+    using Entry = std::pair<float, size_t>;
+    std::vector<Entry> heap;  // min-heap through std::greater, reused across samples
+    auto claim = [&](size_t src) {
+        dist_min[src] = 0.0f;
+        max_tree.update(src);
+        heap.assign(1, {0.0f, src});
+        while (!heap.empty()) {
+            std::pop_heap(heap.begin(), heap.end(), std::greater<Entry>());
+            const Entry top = heap.back();
+            heap.pop_back();
+            const size_t u = top.second;
+            if (top.first > dist_min[u]) continue;
+            for (uint64_t e = graph.indptr[u]; e < graph.indptr[u + 1]; ++e) {
+                const size_t v = graph.indices[e];
+                const float nd = top.first + weights[e];
+                if (nd < dist_min[v]) {
+                    dist_min[v] = nd;
+                    max_tree.update(v);
+                    heap.emplace_back(nd, v);
+                    std::push_heap(heap.begin(), heap.end(), std::greater<Entry>());
                 }
-                if (dist < dist_min[i]) dist_min[i] = dist;
             }
-            selected.push_back(start_idx);
-            res_selected_idx = start_idx;
-            has_prev = true;
         }
+    };
+
+    for (size_t s = 0; s < n_samples; ++s) {
+        out[s] = s < n_starts ? starts[s] : max_tree.argmax();
+        if (stats.radii) stats.radii[s] = dist_min[out[s]];
+        // the last sample only matters to dist_min
+        if (s + 1 < n_samples || stats.dist_min) claim(out[s]);
+    }
+}
+
+// Exact FPS on a nanoflann index. A new sample q can only lower dist_min for
+// points closer to q than their current distance, which is at most the
+// current maximum, so a radius search of that maximum around q finds every
+// point to update: most of the cloud early on, a small neighbourhood late.
+// The MaxTree breaks ties towards the last index and the distances are summed
+// as in the vanilla kernels, so the samples, radii and dist_min are those of
+// fps_sampling_kernel, including the early stop at stop_dist2. Returns the
+// number of samples taken.
+size_t fps_kdtree_kernel(
+    const float* data, size_t P, size_t C,
+    size_t n_samples,
+    const size_t* starts, size_t n_starts,
+    size_t* out,
+    const SampleStats& stats = {},
+    float stop_dist2 = 0.0f,
+    size_t leaf_size = 10,
+    size_t num_threads = 1
+) {
+    if (n_samples == 0) return 0;
+    n_starts = std::min(n_starts, n_samples);
+
+    const float inf = std::numeric_limits<float>::infinity();
+    std::vector<float> dist_buf;
+    float* dist_min = stats.dist_min;
+    if (dist_min) {
+        std::fill(dist_min, dist_min + P, inf);
+    } else {
+        dist_buf.assign(P, inf);
+        dist_min = dist_buf.data();
     }
 
-    py::array_t<size_t> out(selected.size());
-    auto out_buf = out.mutable_unchecked<1>();
-    for (size_t i = 0; i < selected.size(); ++i)
-        out_buf(i) = selected[i];
+    const simd::CloudView view{data, P, C, C, simd::Layout::AoS};
+    for (size_t s = 0; s < n_starts; ++s) {
+        out[s] = starts[s];
+        if (stats.radii) stats.radii[s] = dist_min[starts[s]];
+        simd::update_min(view, 0, P, data + starts[s] * C, 1, dist_min);
+    }
+    if (n_samples == n_starts) return n_starts;
 
-    return out;
+    PointCloud cloud;
+    cloud.N = P;
+    cloud.dim = C;
+    cloud.data = data;
+    cloud.compute_bbox();
+
+    const auto index = build_kdtree_index(cloud, leaf_size, num_threads);
+
+    MaxTree max_tree(dist_min, P, MaxTree::Ties::Last);
+    std::vector<nanoflann::ResultItem<KDTreeIndex::IndexType, float>> matches;
+    const nanoflann::SearchParameters params(0.0f, false);
+    // nanoflann prunes cells with rounded lower bounds; the margin keeps a
+    // point just inside the radius from being pruned, extra hits are harmless
+    const float margin = 1.0f + 1e-4f;
+
+    size_t s = n_starts;
+    for (; s < n_samples; ++s) {
+        const size_t q = max_tree.argmax();
+        const float max_dist = max_tree.max();
+        if (max_dist < stop_dist2) break;
+        out[s] = q;
+        if (stats.radii) stats.radii[s] = max_dist;
+
+        index->radiusSearch(data + q * C, max_dist * margin, matches, params);
+        // past this many hits, rebuilding the tree beats updating entries
+        const bool rebuild = matches.size() > P / MaxTree::kFanout;
+        for (const auto& m : matches) {
+            if (m.second < dist_min[m.first]) {
+                dist_min[m.first] = m.second;
+                if (!rebuild) max_tree.update(m.first);
+            }
+        }
+        if (rebuild) max_tree.update_range(0, P);
+    }
+    return s;
 }
 
-// EXPORT TO _fps_npdu_sample
-py::array_t<size_t> fps_npdu_sampling_py(
+// EXPORT TO _fps_npdu_kdtree_sample
+py::object fps_npdu_kdtree_sampling_py(
     py::array_t<float, py::array::c_style | py::array::forcecast> points,
     size_t n_samples,
     size_t k,
-    py::object start_idx_obj
+    py::object start_idx_obj,
+    bool return_radii,
+    bool return_dist_min,
+    size_t leaf_size,
+    size_t num_threads
 ) {
     StartIndex start_idx = [&]() -> StartIndex {
         if (py::isinstance<py::int_>(start_idx_obj))
@@ -357,20 +993,99 @@ py::array_t<size_t> fps_npdu_sampling_py(
 
     check_py_input(points, n_samples, start_idx);
 
-    if (start_idx.type == StartIndex::SINGLE)
-        return fps_npdu_sampling(points, n_samples, k, start_idx.single_idx);
-    else {
-        PyErr_SetString(PyExc_NotImplementedError, "Array of start indices not implemented yet");
-        throw py::error_already_set();
+    ssize_t P = points.shape(0);
+    ssize_t C = points.shape(1);
+
+    if (P <= 0 || C <= 0)
+        throw py::value_error("points must be a 2D array with at least one column");
+    if (n_samples > 0 && start_idx.size() == 0)
+        throw py::value_error("start_idx must contain at least one index");
+    if (leaf_size == 0)
+        throw py::value_error("leaf_size must be >= 1");
+
+    py::array_t<size_t> out(n_samples);
+    size_t* out_ptr = out.mutable_data();
+    StatsOutput extra(return_radii, return_dist_min, n_samples, static_cast<size_t>(P));
+    {
+        py::gil_scoped_release release;
+        fps_npdu_kdtree_kernel(
+            points.data(), static_cast<size_t>(P), static_cast<size_t>(C),
+            n_samples, k, start_idx.data(), start_idx.size(), out_ptr, extra.stats,
+            leaf_size, num_threads
+        );
     }
+    return extra.result(out);
 }
 
-// EXPORT TO _fps_npdu_kdtree_sample
-py::array_t<size_t> fps_npdu_kdtree_sampling_py(
+// EXPORT TO _knn_graph
+py::tuple knn_graph_py(
     py::array_t<float, py::array::c_style | py::array::forcecast> points,
-    size_t n_samples,
     size_t k,
-    py::object start_idx_obj
+    size_t leaf_size,
+    size_t num_threads
+) {
+    if (points.ndim() != 2 || points.shape(1) == 0)
+        throw py::value_error("points must be a 2D array with at least one column");
+    if (k == 0)
+        throw py::value_error("k must be >= 1");
+    if (leaf_size == 0)
+        throw py::value_error("leaf_size must be >= 1");
+    const size_t P = static_cast<size_t>(points.shape(0));
+    const size_t C = static_cast<size_t>(points.shape(1));
+    if (P > std::numeric_limits<uint32_t>::max())
+        throw py::value_error("knn graphs support at most 2**32 - 1 points");
+
+    const size_t k_use = std::min(k, P);
+    py::array_t<uint64_t> indptr(static_cast<ssize_t>(P + 1));
+    py::array_t<uint32_t> indices(static_cast<ssize_t>(P * k_use));
+    py::array_t<float> dists(static_cast<ssize_t>(P * k_use));
+    uint64_t* indptr_ptr = indptr.mutable_data();
+    uint32_t* indices_ptr = indices.mutable_data();
+    float* dists_ptr = dists.mutable_data();
+    {
+        py::gil_scoped_release release;
+        build_knn_graph(points.data(), P, C, k, leaf_size, num_threads,
+                        indptr_ptr, indices_ptr, dists_ptr);
+    }
+    return py::make_tuple(indptr, indices, dists);
+}
+
+// CSR arrays from Python, checked against a cloud of P points.
+CsrGraph check_csr_graph(
+    const py::array_t<uint64_t, py::array::c_style | py::array::forcecast>& indptr,
+    const py::array_t<uint32_t, py::array::c_style | py::array::forcecast>& indices,
+    size_t P
+) {
+    if (indptr.ndim() != 1 || static_cast<size_t>(indptr.shape(0)) != P + 1)
+        throw py::value_error("indptr must be a 1D array of n_pts + 1 entries");
+    if (indices.ndim() != 1)
+        throw py::value_error("indices must be a 1D array");
+    const uint64_t* ip = indptr.data();
+    const uint32_t* ix = indices.data();
+    if (ip[0] != 0 || ip[P] != static_cast<uint64_t>(indices.shape(0)))
+        throw py::value_error("indptr must start at 0 and end at len(indices)");
+    for (size_t i = 0; i < P; ++i) {
+        if (ip[i + 1] < ip[i])
+            throw py::value_error("indptr must be non-decreasing");
+    }
+    for (ssize_t e = 0; e < indices.shape(0); ++e) {
+        if (ix[e] >= P)
+            throw py::value_error(
+                "All entries of indices must be less than the number of points: " +
+                std::to_string(ix[e]) + ", P=" + std::to_string(P));
+    }
+    return {P, ip, ix};
+}
+
+// EXPORT TO _fps_npdu_graph_sample
+py::object fps_npdu_graph_sampling_py(
+    py::array_t<float, py::array::c_style | py::array::forcecast> points,
+    size_t n_samples,
+    py::array_t<uint64_t, py::array::c_style | py::array::forcecast> indptr,
+    py::array_t<uint32_t, py::array::c_style | py::array::forcecast> indices,
+    py::object start_idx_obj,
+    bool return_radii,
+    bool return_dist_min
 ) {
     StartIndex start_idx = [&]() -> StartIndex {
         if (py::isinstance<py::int_>(start_idx_obj))
@@ -383,91 +1098,129 @@ py::array_t<size_t> fps_npdu_kdtree_sampling_py(
 
     check_py_input(points, n_samples, start_idx);
 
-    if (start_idx.type == StartIndex::ARRAY) {
-        PyErr_SetString(PyExc_NotImplementedError, "Array of start indices not implemented yet");
-        throw py::error_already_set();
-    }
-
-    auto pts = points.unchecked<2>();
-    ssize_t P = pts.shape(0);
-    ssize_t C = pts.shape(1);
+    ssize_t P = points.shape(0);
+    ssize_t C = points.shape(1);
 
     if (P <= 0 || C <= 0)
         throw py::value_error("points must be a 2D array with at least one column");
+    if (n_samples > 0 && start_idx.size() == 0)
+        throw py::value_error("start_idx must contain at least one index");
+    const CsrGraph graph = check_csr_graph(indptr, indices, static_cast<size_t>(P));
 
-    PointCloud cloud;
-    cloud.N = static_cast<size_t>(P);
-    cloud.dim = static_cast<size_t>(C);
-    cloud.data = points.data();
-
-    using KDTree = nanoflann::KDTreeSingleIndexAdaptor<nanoflann::L2_Simple_Adaptor<float, PointCloud>, PointCloud, -1>;
-    KDTree index(static_cast<int>(C), cloud, nanoflann::KDTreeSingleIndexAdaptorParams(10));
-    index.buildIndex();
-
-    std::vector<float> dist_min(P, std::numeric_limits<float>::infinity());
-    std::vector<size_t> selected;
-    selected.reserve(n_samples);
+    py::array_t<size_t> out(n_samples);
+    size_t* out_ptr = out.mutable_data();
+    StatsOutput extra(return_radii, return_dist_min, n_samples, static_cast<size_t>(P));
+    {
+        py::gil_scoped_release release;
+        fps_npdu_graph_kernel(
+            points.data(), static_cast<size_t>(P), static_cast<size_t>(C), graph,
+            n_samples, start_idx.data(), start_idx.size(), out_ptr, extra.stats
+        );
+    }
+    return extra.result(out);
+}
 
-    size_t res_selected_idx = start_idx.single_idx;
-    bool has_prev = false;
+// EXPORT TO _mesh_graph
+py::tuple mesh_graph_py(
+    py::array_t<float, py::array::c_style | py::array::forcecast> points,
+    py::array_t<uint32_t, py::array::c_style | py::array::forcecast> faces
+) {
+    if (points.ndim() != 2 || points.shape(1) == 0)
+        throw py::value_error("points must be a 2D array with at least one column");
+    if (faces.ndim() != 2 || faces.shape(1) != 3)
+        throw py::value_error("faces must be an array of shape (n_faces, 3)");
+    const size_t P = static_cast<size_t>(points.shape(0));
+    const size_t C = static_cast<size_t>(points.shape(1));
+    const size_t F = static_cast<size_t>(faces.shape(0));
+    const uint32_t* face_ptr = faces.data();
+    for (size_t f = 0; f < 3 * F; ++f) {
+        if (face_ptr[f] >= P)
+            throw py::value_error(
+                "All vertex indices in faces must be less than the number of points: " +
+                std::to_string(face_ptr[f]) + ", P=" + std::to_string(P));
+    }
 
-    size_t k_use = std::min<size_t>(k, static_cast<size_t>(P));
-    std::vector<size_t> ret_indexes(k_use);
-    std::vector<float> out_dists(k_use);
+    std::vector<uint64_t> indptr;
+    std::vector<uint32_t> indices;
+    std::vector<float> lengths;
+    {
+        py::gil_scoped_release release;
+        mesh_edges(face_ptr, F, P, indptr, indices);
+        lengths = edge_lengths(points.data(), C, CsrGraph{P, indptr.data(), indices.data()});
+    }
+    return py::make_tuple(to_array(indptr), to_array(indices), to_array(lengths));
+}
 
-    while (selected.size() < n_samples) {
-        if (has_prev) {
-            std::vector<float> query(static_cast<size_t>(C));
-            for (ssize_t d = 0; d < C; ++d) query[d] = pts(res_selected_idx, d);
+// EXPORT TO _geodesic_fps_sample
+py::object geodesic_fps_sampling_py(
+    py::array_t<float, py::array::c_style | py::array::forcecast> points,
+    size_t n_samples,
+    py::array_t<uint64_t, py::array::c_style | py::array::forcecast> indptr,
+    py::array_t<uint32_t, py::array::c_style | py::array::forcecast> indices,
+    py::object weights_obj,
+    py::object start_idx_obj,
+    bool return_radii,
+    bool return_dist_min
+) {
+    StartIndex start_idx = [&]() -> StartIndex {
+        if (py::isinstance<py::int_>(start_idx_obj))
+            return StartIndex(start_idx_obj.cast<size_t>());
+        else if (py::isinstance<py::array_t<size_t>>(start_idx_obj))
+            return StartIndex(start_idx_obj.cast<py::array_t<size_t>>());
+        else
+            throw py::type_error("start_idx must be int or 1D numpy array of size_t");
+    }();
 
-            nanoflann::KNNResultSet<float> resultSet(static_cast<int>(k_use));
-            resultSet.init(ret_indexes.data(), out_dists.data());
-            nanoflann::SearchParameters params;
-            index.findNeighbors(resultSet, query.data(), params);
-
-            for (size_t idx_i = 0; idx_i < k_use; ++idx_i) {
-                size_t nb = ret_indexes[idx_i];
-                float dist = 0.0f;
-                for (ssize_t d = 0; d < C; ++d) {
-                    float diff = pts(nb, d) - pts(res_selected_idx, d);
-                    dist += diff * diff;
-                }
-                if (dist < dist_min[nb]) dist_min[nb] = dist;
-            }
+    check_py_input(points, n_samples, start_idx);
 
-            size_t max_idx = 0;
-            float max_val = -1.0f;
-            for (ssize_t i = 0; i < P; ++i) {
-                if (dist_min[i] > max_val) { max_val = dist_min[i]; max_idx = i; }
-            }
+    ssize_t P = points.shape(0);
+    ssize_t C = points.shape(1);
 
-            selected.push_back(max_idx);
-            res_selected_idx = max_idx;
-        } else {
-            for (ssize_t i = 0; i < P; ++i) {
-                float dist = 0.0f;
-                for (ssize_t j = 0; j < C; ++j) {
-                    float d = pts(i,j) - pts(res_selected_idx,j);
-                    dist += d*d;
-                }
-                if (dist < dist_min[i]) dist_min[i] = dist;
-            }
-            selected.push_back(res_selected_idx);
-            has_prev = true;
+    if (P <= 0 || C <= 0)
+        throw py::value_error("points must be a 2D array with at least one column");
+    if (n_samples > 0 && start_idx.size() == 0)
+        throw py::value_error("start_idx must contain at least one index");
+    const CsrGraph graph = check_csr_graph(indptr, indices, static_cast<size_t>(P));
+
+    // edge weights as given, or the Euclidean edge lengths
+    std::vector<float> lengths;
+    py::array_t<float, py::array::c_style | py::array::forcecast> weights;
+    const float* weight_ptr;
+    if (weights_obj.is_none()) {
+        lengths = edge_lengths(points.data(), static_cast<size_t>(C), graph);
+        weight_ptr = lengths.data();
+    } else {
+        weights = weights_obj.cast<py::array_t<float, py::array::c_style | py::array::forcecast>>();
+        if (weights.ndim() != 1 || weights.shape(0) != indices.shape(0))
+            throw py::value_error("weights must be a 1D array with one entry per edge");
+        weight_ptr = weights.data();
+        for (ssize_t e = 0; e < weights.shape(0); ++e) {
+            if (!(weight_ptr[e] >= 0.0f))
+                throw py::value_error("weights must be non-negative");
         }
     }
 
-    py::array_t<size_t> out(selected.size());
-    auto out_buf = out.mutable_unchecked<1>();
-    for (size_t i = 0; i < selected.size(); ++i) out_buf(i) = selected[i];
-
-    return out;
+    py::array_t<size_t> out(n_samples);
+    size_t* out_ptr = out.mutable_data();
+    StatsOutput extra(return_radii, return_dist_min, n_samples, static_cast<size_t>(P));
+    {
+        py::gil_scoped_release release;
+        geodesic_fps_kernel(graph, weight_ptr, n_samples, start_idx.data(), start_idx.size(),
+                            out_ptr, extra.stats);
+    }
+    return extra.result(out);
 }
 
-py::array_t<size_t> bucket_fps_kdtree_sampling_py(
+// EXPORT TO _fps_kdtree_sample
+py::object fps_kdtree_sampling_py(
     py::array_t<float, py::array::c_style | py::array::forcecast> points,
     size_t n_samples,
-    py::object start_idx_obj
+    py::object start_idx_obj,
+    bool return_radii,
+    bool return_dist_min,
+    float radius,
+    size_t leaf_size,
+    size_t num_threads
 ) {
     StartIndex start_idx = [&]() -> StartIndex {
         if (py::isinstance<py::int_>(start_idx_obj))
@@ -478,10 +1231,61 @@ py::array_t<size_t> bucket_fps_kdtree_sampling_py(
             throw py::type_error("start_idx must be int or 1D numpy array of size_t");
     }();
 
-    if (start_idx.type == StartIndex::ARRAY) {
-        PyErr_SetString(PyExc_NotImplementedError, "Array of start indices not implemented yet");
-        throw py::error_already_set();
+    check_py_input(points, n_samples, start_idx);
+
+    ssize_t P = points.shape(0);
+    ssize_t C = points.shape(1);
+
+    if (P <= 0 || C <= 0)
+        throw py::value_error("points must be a 2D array with at least one column");
+    if (n_samples > 0 && start_idx.size() == 0)
+        throw py::value_error("start_idx must contain at least one index");
+    if (leaf_size == 0)
+        throw py::value_error("leaf_size must be >= 1");
+
+    py::array_t<size_t> out(n_samples);
+    size_t* out_ptr = out.mutable_data();
+    StatsOutput extra(return_radii, return_dist_min, n_samples, static_cast<size_t>(P));
+    size_t n_taken;
+    {
+        py::gil_scoped_release release;
+        n_taken = fps_kdtree_kernel(
+            points.data(), static_cast<size_t>(P), static_cast<size_t>(C),
+            n_samples, start_idx.data(), start_idx.size(), out_ptr, extra.stats,
+            radius * radius, leaf_size, num_threads
+        );
     }
+    return extra.result(truncated(out, n_taken));
+}
+
+BucketLayout bucket_layout(const std::string& layout, ssize_t P) {
+    if (layout == "pointer")
+        return BUCKET_LAYOUT_POINTER;
+    if (layout != "flat")
+        throw py::value_error("layout must be one of 'pointer', 'flat', but got '" + layout + "'");
+    if (static_cast<size_t>(P) > max_flat_points)
+        throw py::value_error("the flat layout takes at most 2^31 points");
+    return BUCKET_LAYOUT_FLAT;
+}
+
+py::object bucket_fps_kdtree_sampling_py(
+    py::array_t<float, py::array::c_style | py::array::forcecast> points,
+    size_t n_samples,
+    py::object start_idx_obj,
+    bool return_radii,
+    bool return_dist_min,
+    float radius,
+    const std::string& layout,
+    size_t num_threads
+) {
+    StartIndex start_idx = [&]() -> StartIndex {
+        if (py::isinstance<py::int_>(start_idx_obj))
+            return StartIndex(start_idx_obj.cast<size_t>());
+        else if (py::isinstance<py::array_t<size_t>>(start_idx_obj))
+            return StartIndex(start_idx_obj.cast<py::array_t<size_t>>());
+        else
+            throw py::type_error("start_idx must be int or 1D numpy array of size_t");
+    }();
 
     check_py_input(points, n_samples, start_idx);
 
@@ -491,39 +1295,61 @@ py::array_t<size_t> bucket_fps_kdtree_sampling_py(
     ssize_t P = points.shape(0);
     ssize_t C = points.shape(1);
 
-    if (start_idx.single_idx >= static_cast<size_t>(P)) {
-        throw py::value_error("start_idx out of range");
+    if (start_idx.size() == 0) {
+        throw py::value_error("start_idx must contain at least one index");
     }
     if (n_samples == 0 || n_samples > static_cast<size_t>(P)) {
         throw py::value_error("n_samples must be in [1, num_points]");
     }
 
+    const BucketLayout layout_id = bucket_layout(layout, P);
     auto buf = points.unchecked<2>();
 
     py::array_t<size_t> out(n_samples);
     size_t* out_ptr = static_cast<size_t*>(out.mutable_data());
-
-    int ret = bucket_fps_kdtree(
-        buf.data(0,0),                       // raw_data
-        static_cast<size_t>(P),              // n_points
-        static_cast<size_t>(C),              // dim
-        n_samples,                           // n_samples
-        start_idx.single_idx,                // start_idx
-        out_ptr                              // output buffer
-    );
+    StatsOutput extra(return_radii, return_dist_min, n_samples, static_cast<size_t>(P));
+    BucketFpsOptions opts{};
+    opts.size = sizeof(opts);
+    opts.radius = radius;
+    opts.layout = layout_id;
+    opts.num_threads = num_threads;
+    opts.sampled_point_radii = extra.stats.radii;
+    opts.point_dist_min = extra.stats.dist_min;
+
+    int ret;
+    size_t n_taken = 0;
+    {
+        py::gil_scoped_release release;
+        ret = bucket_fps_kdtree_ex(
+            buf.data(0,0),                       // raw_data
+            static_cast<size_t>(P),              // n_points
+            static_cast<size_t>(C),              // dim
+            n_samples,                           // n_samples
+            start_idx.data(),                    // start_idx
+            start_idx.size(),                    // n_starts
+            &opts,                               // options
+            out_ptr,                             // output buffer
+            &n_taken                             // samples taken
+        );
+    }
 
     if (ret != 0) {
         throw std::runtime_error("bucket_fps_kdtree failed with error code " + std::to_string(ret));
     }
 
-    return out;
+    return extra.result(truncated(out, n_taken));
 }
 
-py::array_t<size_t> bucket_fps_kdline_sampling_py(
+py::object bucket_fps_kdline_sampling_py(
     py::array_t<float, py::array::c_style | py::array::forcecast> points,
     size_t n_samples,
     size_t height,
-    py::object start_idx_obj
+    py::object start_idx_obj,
+    bool return_radii,
+    bool return_dist_min,
+    float radius,
+    const std::string& layout,
+    size_t num_threads
 ) {
     StartIndex start_idx = [&]() -> StartIndex {
         if (py::isinstance<py::int_>(start_idx_obj))
@@ -534,20 +1360,16 @@ py::array_t<size_t> bucket_fps_kdline_sampling_py(
             throw py::type_error("start_idx must be int or 1D numpy array of size_t");
     }();
 
-    if (start_idx.type == StartIndex::ARRAY) {
-        PyErr_SetString(PyExc_NotImplementedError, "Array of start indices not implemented yet");
-        throw py::error_already_set();
-    }
-
     if (points.ndim() != 2) {
         throw py::value_error("points must be a 2D float32 array");
     }
+    check_py_input(points, n_samples, start_idx);
 
     ssize_t P = points.shape(0);
     ssize_t C = points.shape(1);
 
-    if (start_idx.single_idx >= static_cast<size_t>(P)) {
-        throw py::value_error("start_idx out of range");
+    if (start_idx.size() == 0) {
+        throw py::value_error("start_idx must contain at least one index");
     }
     if (n_samples == 0 || n_samples > static_cast<size_t>(P)) {
         throw py::value_error("n_samples must be in [1, num_points]");
@@ -556,33 +1378,378 @@ py::array_t<size_t> bucket_fps_kdline_sampling_py(
         throw py::value_error("height must be >= 1");
     }
 
+    const BucketLayout layout_id = bucket_layout(layout, P);
     auto buf = points.unchecked<2>();
 
     py::array_t<size_t> out(n_samples);
     size_t* out_ptr = static_cast<size_t*>(out.mutable_data());
-
-    int ret = bucket_fps_kdline(
-        buf.data(0,0),                        // raw_data
-        static_cast<size_t>(P),               // n_points
-        static_cast<size_t>(C),               // dim
-        n_samples,                            // n_samples
-        start_idx.single_idx,                 // start_idx
-        height,                               // window height
-        out_ptr                               // output buffer
-    );
+    StatsOutput extra(return_radii, return_dist_min, n_samples, static_cast<size_t>(P));
+    BucketFpsOptions opts{};
+    opts.size = sizeof(opts);
+    opts.radius = radius;
+    opts.layout = layout_id;
+    opts.num_threads = num_threads;
+    opts.sampled_point_radii = extra.stats.radii;
+    opts.point_dist_min = extra.stats.dist_min;
+
+    int ret;
+    size_t n_taken = 0;
+    {
+        py::gil_scoped_release release;
+        ret = bucket_fps_kdline_ex(
+            buf.data(0,0),                        // raw_data
+            static_cast<size_t>(P),               // n_points
+            static_cast<size_t>(C),               // dim
+            n_samples,                            // n_samples
+            start_idx.data(),                     // start_idx
+            start_idx.size(),                     // n_starts
+            height,                               // window height
+            &opts,                                // options
+            out_ptr,                              // output buffer
+            &n_taken                              // samples taken
+        );
+    }
 
     if (ret != 0) {
         throw std::runtime_error("bucket_fps_kdline failed with error code " + std::to_string(ret));
     }
 
+    return extra.result(truncated(out, n_taken));
+}
+
+// One cloud in, n_samples indices out: row-major P x C points and a start
+// index. The batched entry points run one of these per cloud. `param` is the
+// window size k for the NPDU engines and the tree height for bucket_kdline;
+// the other engines ignore it.
+using CloudSampler = std::function<void(
+    const float* data, size_t P, size_t C,
+    size_t n_samples, size_t param, size_t start_idx, size_t* out)>;
+
+CloudSampler make_cloud_sampler(const std::string& method) {
+    if (method == "fps") {
+        return [](const float* data, size_t P, size_t C, size_t n_samples, size_t, size_t start, size_t* out) {
+            simd::CloudView pts{data, P, C, C, simd::Layout::AoS};
+            fps_sampling_kernel(pts, n_samples, &start, 1, 1, out);
+        };
+    }
+    if (method == "fps_kdtree") {
+        return [](const float* data, size_t P, size_t C, size_t n_samples, size_t, size_t start, size_t* out) {
+            fps_kdtree_kernel(data, P, C, n_samples, &start, 1, out);
+        };
+    }
+    if (method == "npdu") {
+        return [](const float* data, size_t P, size_t C, size_t n_samples, size_t k, size_t start, size_t* out) {
+            npdu_kernel_for(C)(data, P, C, n_samples, k, &start, 1, out, {});
+        };
+    }
+    if (method == "npdu_morton") {
+        return [](const float* data, size_t P, size_t C, size_t n_samples, size_t k, size_t start, size_t* out) {
+            npdu_kernel_for(C, true)(data, P, C, n_samples, k, &start, 1, out, {});
+        };
+    }
+    if (method == "npdu_kdtree") {
+        return [](const float* data, size_t P, size_t C, size_t n_samples, size_t k, size_t start, size_t* out) {
+            fps_npdu_kdtree_kernel(data, P, C, n_samples, k, &start, 1, out);
+        };
+    }
+    if (method == "bucket_kdtree") {
+        return [](const float* data, size_t P, size_t C, size_t n_samples, size_t, size_t start, size_t* out) {
+            int ret = bucket_fps_kdtree(data, P, C, n_samples, start, out);
+            if (ret != 0)
+                throw std::runtime_error("bucket_fps_kdtree failed with error code " + std::to_string(ret));
+        };
+    }
+    if (method == "bucket_kdline") {
+        return [](const float* data, size_t P, size_t C, size_t n_samples, size_t height, size_t start, size_t* out) {
+            int ret = bucket_fps_kdline(data, P, C, n_samples, start, height, out);
+            if (ret != 0)
+                throw std::runtime_error("bucket_fps_kdline failed with error code " + std::to_string(ret));
+        };
+    }
+    throw py::value_error(
+        "method must be one of 'fps', 'fps_kdtree', 'npdu', 'npdu_morton', 'npdu_kdtree', 'bucket_kdtree', 'bucket_kdline', but got '" +
+        method + "'"
+    );
+}
+
+// Checks shared by the batched entry points once the clouds are laid out as
+// rows of P points with C coordinates.
+void check_sampler_params(const std::string& method, size_t C) {
+    if (C == 0) {
+        throw py::value_error("points must have at least one column");
+    }
+    if ((method == "bucket_kdtree" || method == "bucket_kdline") && C > max_dim) {
+        throw py::value_error(
+            "points must have at most " + std::to_string(max_dim) +
+            " columns, but got " + std::to_string(C)
+        );
+    }
+}
+
+// EXPORT TO _batch_sampling
+py::array_t<size_t> batch_sampling_py(
+    py::array_t<float, py::array::c_style | py::array::forcecast> points,
+    size_t n_samples,
+    py::array_t<size_t, py::array::c_style | py::array::forcecast> start_idx,
+    const std::string& method,
+    size_t param,
+    size_t num_threads
+) {
+    if (points.ndim() != 3) {
+        throw py::value_error(
+            "points must be a 3D array, but got shape " + std::to_string(points.ndim())
+        );
+    }
+    const size_t B = static_cast<size_t>(points.shape(0));
+    const size_t P = static_cast<size_t>(points.shape(1));
+    const size_t C = static_cast<size_t>(points.shape(2));
+
+    check_sampler_params(method, C);
+    if (method == "bucket_kdline" && param == 0) {
+        throw py::value_error("height must be >= 1");
+    }
+    if (n_samples == 0 || n_samples > P) {
+        throw py::value_error(
+            "n_samples must be in [1, num_points]: n_samples=" +
+            std::to_string(n_samples) + ", P=" + std::to_string(P)
+        );
+    }
+    if (start_idx.ndim() != 1 || static_cast<size_t>(start_idx.shape(0)) != B) {
+        throw py::value_error("start_idx must be a 1D array with one index per batch element");
+    }
+    auto starts = start_idx.unchecked<1>();
+    for (size_t b = 0; b < B; ++b) {
+        if (starts(b) >= P) {
+            throw py::value_error(
+                "All indices in start_idx must be less than the number of points: " +
+                std::to_string(starts(b)) + ", P=" + std::to_string(P)
+            );
+        }
+    }
+
+    CloudSampler sampler = make_cloud_sampler(method);
+    py::array_t<size_t> out({static_cast<ssize_t>(B), static_cast<ssize_t>(n_samples)});
+    size_t* out_ptr = out.mutable_data();
+    const float* data = points.data();
+    const size_t* start_ptr = start_idx.data();
+    {
+        py::gil_scoped_release release;
+        size_t n_threads = threading::resolve_num_threads(num_threads, B);
+        threading::parallel_for_dynamic(B, n_threads, [&](size_t b) {
+            sampler(data + b * P * C, P, C, n_samples, param, start_ptr[b], out_ptr + b * n_samples);
+        });
+    }
     return out;
 }
 
+// EXPORT TO _ragged_sampling
+py::array_t<size_t> ragged_sampling_py(
+    py::array_t<float, py::array::c_style | py::array::forcecast> points,
+    py::array_t<size_t, py::array::c_style | py::array::forcecast> offsets,
+    py::array_t<size_t, py::array::c_style | py::array::forcecast> n_samples,
+    py::array_t<size_t, py::array::c_style | py::array::forcecast> start_idx,
+    const std::string& method,
+    py::array_t<size_t, py::array::c_style | py::array::forcecast> params,
+    size_t num_threads
+) {
+    if (points.ndim() != 2) {
+        throw py::value_error(
+            "points must be a 2D array, but got shape " + std::to_string(points.ndim())
+        );
+    }
+    const size_t N = static_cast<size_t>(points.shape(0));
+    const size_t C = static_cast<size_t>(points.shape(1));
+    check_sampler_params(method, C);
+
+    if (offsets.ndim() != 1 || offsets.shape(0) < 1) {
+        throw py::value_error("offsets must be a 1D array of length n_clouds + 1");
+    }
+    const size_t B = static_cast<size_t>(offsets.shape(0)) - 1;
+    for (auto* arr : {&n_samples, &start_idx, &params}) {
+        if (arr->ndim() != 1 || static_cast<size_t>(arr->shape(0)) != B) {
+            throw py::value_error("n_samples, start_idx and params must have one entry per cloud");
+        }
+    }
+
+    auto offs = offsets.unchecked<1>();
+    auto ns = n_samples.unchecked<1>();
+    auto starts = start_idx.unchecked<1>();
+    auto prm = params.unchecked<1>();
+    if (offs(0) != 0 || offs(B) != N) {
+        throw py::value_error("offsets must start at 0 and end at the number of points");
+    }
+
+    // out_offs[b] is where the samples of cloud b start in the output
+    std::vector<size_t> out_offs(B + 1, 0);
+    for (size_t b = 0; b < B; ++b) {
+        if (offs(b + 1) < offs(b)) {
+            throw py::value_error("offsets must be non-decreasing");
+        }
+        const size_t P = offs(b + 1) - offs(b);
+        if (ns(b) > P) {
+            throw py::value_error(
+                "n_samples must be at most the number of points of its cloud: cloud " +
+                std::to_string(b) + ", n_samples=" + std::to_string(ns(b)) + ", P=" + std::to_string(P)
+            );
+        }
+        if (ns(b) > 0 && starts(b) >= P) {
+            throw py::value_error(
+                "start_idx must be less than the number of points of its cloud: cloud " +
+                std::to_string(b) + ", start_idx=" + std::to_string(starts(b)) + ", P=" + std::to_string(P)
+            );
+        }
+        if (method == "bucket_kdline" && ns(b) > 0 && prm(b) == 0) {
+            throw py::value_error("height must be >= 1");
+        }
+        out_offs[b + 1] = out_offs[b] + ns(b);
+    }
+
+    CloudSampler sampler = make_cloud_sampler(method);
+    py::array_t<size_t> out(static_cast<ssize_t>(out_offs[B]));
+    size_t* out_ptr = out.mutable_data();
+    const float* data = points.data();
+    const size_t* offs_ptr = offsets.data();
+    const size_t* ns_ptr = n_samples.data();
+    const size_t* start_ptr = start_idx.data();
+    const size_t* param_ptr = params.data();
+    {
+        py::gil_scoped_release release;
+        size_t n_threads = threading::resolve_num_threads(num_threads, B);
+        threading::parallel_for_stealing(
+            B, n_threads,
+            [&](size_t b) { return (offs_ptr[b + 1] - offs_ptr[b]) * ns_ptr[b]; },
+            [&](size_t b) {
+                if (ns_ptr[b] == 0) return;
+                // each segment is sampled in place; its local indices are
+                // shifted back to rows of the packed array afterwards
+                const size_t begin = offs_ptr[b];
+                size_t* seg_out = out_ptr + out_offs[b];
+                sampler(data + begin * C, offs_ptr[b + 1] - begin, C,
+                        ns_ptr[b], param_ptr[b], start_ptr[b], seg_out);
+                for (size_t i = 0; i < ns_ptr[b]; ++i) seg_out[i] += begin;
+            });
+    }
+    return out;
+}
+
+// Vanilla FPS that keeps dist_min, and the worker pool that refreshes it,
+// between calls. `holder` keeps the array behind `pts` alive.
+class VanillaIncrementalSampler : public IncrementalSampler {
+public:
+    VanillaIncrementalSampler(const simd::CloudView& pts, py::object holder,
+                              size_t start_idx, size_t num_threads)
+        : pts_(pts), holder_(std::move(holder)), start_(start_idx),
+          dist_min_(pts.P, std::numeric_limits<float>::infinity()),
+          refresh_(pts_, dist_min_.data(), num_threads) {}
+
+    size_t next(size_t k, size_t* out) override {
+        const size_t first = taken_;
+        const size_t total = std::min(taken_ + k, pts_.P);
+        if (total == first) return 0;
+
+        size_t s = first;
+        if (s == 0) {
+            last_ = out[0] = start_;
+            s = 1;
+        }
+        for (; s < total; ++s) {
+            last_ = refresh_(last_).idx;
+            out[s - first] = last_;
+        }
+        taken_ = total;
+        return total - first;
+    }
+
+    size_t size() const override { return taken_; }
+
+private:
+    simd::CloudView pts_;
+    py::object holder_;
+    size_t start_;
+    std::vector<float> dist_min_;
+    FpsRefresher refresh_;
+    size_t last_ = 0;
+    size_t taken_ = 0;
+};
+
+// EXPORT TO _FPSSampler
+class FPSSamplerPy {
+public:
+    FPSSamplerPy(
+        py::array_t<float, py::array::forcecast> points,
+        const std::string& method,
+        size_t start_idx,
+        size_t height,
+        size_t num_threads
+    ) {
+        check_py_input(points, 0, StartIndex(start_idx));
+        const size_t P = static_cast<size_t>(points.shape(0));
+        const size_t C = static_cast<size_t>(points.shape(1));
+        n_points_ = P;
+
+        if (method == "fps") {
+            py::object holder = points;
+            simd::CloudView pts = make_cloud_view(points, holder);
+            sampler_.reset(new VanillaIncrementalSampler(pts, holder, start_idx, num_threads));
+        } else if (method == "bucket_kdtree" || method == "bucket_kdline") {
+            if (C > max_dim) {
+                throw py::value_error(
+                    "points must have at most " + std::to_string(max_dim) +
+                    " columns, but got " + std::to_string(C)
+                );
+            }
+            if (method == "bucket_kdline" && height == 0) {
+                throw py::value_error("height must be >= 1");
+            }
+            auto contiguous = py::array_t<float, py::array::c_style | py::array::forcecast>::ensure(points);
+            py::gil_scoped_release release;
+            sampler_ = make_bucket_incremental_sampler(
+                contiguous.data(), P, C, start_idx, method == "bucket_kdline" ? height : 0);
+        } else {
+            throw py::value_error(
+                "method must be one of 'fps', 'bucket_kdtree', 'bucket_kdline', but got '" + method + "'"
+            );
+        }
+    }
+
+    py::array_t<size_t> next(size_t k) {
+        std::vector<size_t> buf;
+        size_t n;
+        {
+            // one next() at a time; take the lock without holding the GIL
+            py::gil_scoped_release release;
+            std::lock_guard<std::mutex> lock(mutex_);
+            // no more than the points left, however large k is
+            buf.resize(std::min(k, n_points_ - sampler_->size()));
+            n = sampler_->next(buf.size(), buf.data());
+        }
+        py::array_t<size_t> out(static_cast<ssize_t>(n));
+        std::copy(buf.begin(), buf.begin() + n, out.mutable_data());
+        return out;
+    }
+
+    size_t size() {
+        py::gil_scoped_release release;
+        std::lock_guard<std::mutex> lock(mutex_);
+        return sampler_->size();
+    }
+
+private:
+    std::unique_ptr<IncrementalSampler> sampler_;
+    size_t n_points_;
+    std::mutex mutex_;
+};
+
 PYBIND11_MODULE(_fpsample, m, py::mod_gil_not_used(), py::multiple_interpreters::per_interpreter_gil()) {
     m.doc() = R"pbdoc(
         Python efficient farthest point sampling (FPS) library
         -----------------------
 
+        Every sampling function releases the GIL while it samples and keeps
+        no shared mutable state, so concurrent calls from several Python
+        threads are safe and run in parallel (also on free-threaded builds).
+        The input arrays must not be modified while a call is running.
+
         .. currentmodule:: fpsample
 
         .. autosummary::
@@ -591,18 +1758,36 @@ PYBIND11_MODULE(_fpsample, m, py::mod_gil_not_used(), py::multiple_interpreters:
            _fps_sampling
            _fps_npdu_sampling
            _fps_npdu_kdtree_sampling
+           _fps_kdtree_sampling
+           _knn_graph
+           _fps_npdu_graph_sampling
+           _mesh_graph
+           _geodesic_fps_sampling
            _bucket_fps_kdtree_sampling
            _bucket_fps_kdline_sampling
+           _batch_sampling
+           _ragged_sampling
+           _FPSSampler
+           _simd_isa
     )pbdoc";
 
+    // pick the SIMD kernels once, at import time
+    simd::active();
+
     m.def("_fps_sampling", &_fps_sampling, R"pbdoc(
             Farthest Point Sampling (FPS)
             Args:
-                points (np.ndarray[float32, 2D]): N x C point array.
+                points (np.ndarray[float32, 2D]): N x C point array, C- or Fortran-ordered.
                 n_samples (int): number of samples to pick.
                 start_idx (int or np.ndarray[int32, 1D]): initial index or indices to start FPS.
+                num_threads (int): number of threads, 0 for all cores.
+                return_radii (bool): also return the squared insertion radius of every sample.
+                return_dist_min (bool): also return the final squared distance of every point to the samples.
+                radius (float): stop once every point is closer than radius to a sample, n_samples is then
+                the maximum; 0 always takes n_samples.
             Returns:
-                np.ndarray[int32]: sampled point indices.
+                np.ndarray[int32]: sampled point indices, or (indices, radii, dist_min) with None
+                for the outputs that were not requested.
     )pbdoc");
 
     m.def("_fps_npdu_sampling", &fps_npdu_sampling_py, R"pbdoc(
@@ -611,9 +1796,14 @@ PYBIND11_MODULE(_fpsample, m, py::mod_gil_not_used(), py::multiple_interpreters:
                 points (np.ndarray[float32, 2D]): N x C point array.
                 n_samples (int): number of samples to pick.
                 k (int): number of neighbors for local update.
-                start_idx (int): initial index to start FPS.
+                start_idx (int or np.ndarray[uint64, 1D]): initial index or seed indices, which become the first samples.
+                return_radii (bool): also return the squared insertion radius of every sample.
+                return_dist_min (bool): also return the final squared distance of every point to the samples.
+                reorder (bool): sort the points along a Morton curve first, so the index window holds spatial
+                neighbours whatever the input order. Indices stay in the input order.
             Returns:
-                np.ndarray[int32]: sampled point indices.
+                np.ndarray[int32]: sampled point indices, or (indices, radii, dist_min) with None
+                for the outputs that were not requested.
     )pbdoc");
 
     m.def("_fps_npdu_kdtree_sampling", &fps_npdu_kdtree_sampling_py, R"pbdoc(
@@ -622,9 +1812,84 @@ PYBIND11_MODULE(_fpsample, m, py::mod_gil_not_used(), py::multiple_interpreters:
                 points (np.ndarray[float32, 2D]): N x C point array.
                 n_samples (int): number of samples to pick.
                 k (int): number of neighbors for local update.
-                start_idx (int): initial index to start FPS.
+                start_idx (int or np.ndarray[uint64, 1D]): initial index or seed indices, which become the first samples.
+                return_radii (bool): also return the squared insertion radius of every sample.
+                return_dist_min (bool): also return the final squared distance of every point to the samples.
+                leaf_size (int): maximum number of points in a leaf of the KD-tree.
+                num_threads (int): threads used to build the KD-tree, 0 for all cores.
             Returns:
-                np.ndarray[int32]: sampled point indices.
+                np.ndarray[int32]: sampled point indices, or (indices, radii, dist_min) with None
+                for the outputs that were not requested.
+    )pbdoc");
+
+    m.def("_fps_kdtree_sampling", &fps_kdtree_sampling_py, R"pbdoc(
+            Exact FPS using KD-tree radius searches, same result as _fps_sampling
+            Args:
+                points (np.ndarray[float32, 2D]): N x C point array.
+                n_samples (int): number of samples to pick.
+                start_idx (int or np.ndarray[uint64, 1D]): initial index or seed indices, which become the first samples.
+                return_radii (bool): also return the squared insertion radius of every sample.
+                return_dist_min (bool): also return the final squared distance of every point to the samples.
+                radius (float): stop once every point is closer than radius to a sample, n_samples is then
+                the maximum; 0 always takes n_samples.
+                leaf_size (int): maximum number of points in a leaf of the KD-tree.
+                num_threads (int): threads used to build the KD-tree, 0 for all cores.
+            Returns:
+                np.ndarray[int32]: sampled point indices, or (indices, radii, dist_min) with None
+                for the outputs that were not requested.
+    )pbdoc");
+
+    m.def("_knn_graph", &knn_graph_py, R"pbdoc(
+            All-points kNN graph in CSR form
+            Args:
+                points (np.ndarray[float32, 2D]): N x C point array.
+                k (int): neighbours per point, the point itself included; capped at N.
+                leaf_size (int): maximum number of points in a leaf of the KD-tree.
+                num_threads (int): threads for the KD-tree build and the queries, 0 for all cores.
+            Returns:
+                (indptr, indices, dists): np.ndarray[uint64] of N + 1 offsets, np.ndarray[uint32] of neighbour
+                indices, nearest first, and np.ndarray[float32] of their squared distances.
+    )pbdoc");
+
+    m.def("_fps_npdu_graph_sampling", &fps_npdu_graph_sampling_py, R"pbdoc(
+            FPS with Nearest Point Distance Update over a precomputed neighbourhood graph
+            Args:
+                points (np.ndarray[float32, 2D]): N x C point array.
+                n_samples (int): number of samples to pick.
+                indptr (np.ndarray[uint64, 1D]): CSR offsets, N + 1 entries.
+                indices (np.ndarray[uint32, 1D]): CSR neighbour indices.
+                start_idx (int or np.ndarray[uint64, 1D]): initial index or seed indices, which become the first samples.
+                return_radii (bool): also return the squared insertion radius of every sample.
+                return_dist_min (bool): also return the final squared distance of every point to the samples.
+            Returns:
+                np.ndarray[int32]: sampled point indices, or (indices, radii, dist_min) with None
+                for the outputs that were not requested.
+    )pbdoc");
+
+    m.def("_mesh_graph", &mesh_graph_py, R"pbdoc(
+            Edge graph of a triangle mesh in CSR form
+            Args:
+                points (np.ndarray[float32, 2D]): N x C vertex array.
+                faces (np.ndarray[uint32, 2D]): F x 3 vertex indices of the triangles.
+            Returns:
+                (indptr, indices, lengths): np.ndarray[uint64] of N + 1 offsets, np.ndarray[uint32] of neighbour
+                indices, each undirected edge listed from both ends, and np.ndarray[float32] of edge lengths.
+    )pbdoc");
+
+    m.def("_geodesic_fps_sampling", &geodesic_fps_sampling_py, R"pbdoc(
+            Geodesic FPS, with shortest-path distances along the edges of a graph
+            Args:
+                points (np.ndarray[float32, 2D]): N x C point array.
+                n_samples (int): number of samples to pick.
+                indptr (np.ndarray[uint64, 1D]): CSR offsets, N + 1 entries.
+                indices (np.ndarray[uint32, 1D]): CSR neighbour indices; edges are followed as stored.
+                weights (np.ndarray[float32, 1D] or None): non-negative edge lengths, Euclidean lengths if None.
+                start_idx (int or np.ndarray[uint64, 1D]): initial index or seed indices, which become the first samples.
+                return_radii (bool): also return the geodesic insertion radius of every sample.
+                return_dist_min (bool): also return the final geodesic distance of every point to the samples.
+            Returns:
+                np.ndarray[int32]: sampled point indices, or (indices, radii, dist_min) with None
+                for the outputs that were not requested. Distances are not squared.
     )pbdoc");
 
     m.def("_bucket_fps_kdtree_sampling",
@@ -634,9 +1899,16 @@ PYBIND11_MODULE(_fpsample, m, py::mod_gil_not_used(), py::multiple_interpreters:
           Args:
               points (np.ndarray[float32, 2D]): N x C point array.
               n_samples (int): number of samples to pick.
-              start_idx (int): initial index to start FPS.
+              start_idx (int or np.ndarray[uint64, 1D]): initial index or seed indices, which become the first samples.
+              return_radii (bool): also return the squared insertion radius of every sample.
+              return_dist_min (bool): also return the final squared distance of every point to the samples.
+              radius (float): stop once every point is closer than radius to a sample, n_samples is then
+              the maximum; 0 always takes n_samples.
+              layout (str): "pointer" for the KDNode tree, "flat" for the flattened one; same samples.
+              num_threads (int): threads used to build the KD-tree, 0 for all cores; same samples.
           Returns:
-              np.ndarray[int32]: sampled point indices.
+              np.ndarray[int32]: sampled point indices, or (indices, radii, dist_min) with None
+              for the outputs that were not requested.
       )pbdoc");
 
 m.def("_bucket_fps_kdline_sampling",
@@ -647,11 +1919,73 @@ m.def("_bucket_fps_kdline_sampling",
               points (np.ndarray[float32, 2D]): N x C point array.
               n_samples (int): number of samples to pick.
               height (int): window size around selected point.
-              start_idx (int): first index.
+              start_idx (int or np.ndarray[uint64, 1D]): initial index or seed indices, which become the first samples.
+              return_radii (bool): also return the squared insertion radius of every sample.
+              return_dist_min (bool): also return the final squared distance of every point to the samples.
+              radius (float): stop once every point is closer than radius to a sample, n_samples is then
+              the maximum; 0 always takes n_samples.
+              layout (str): "pointer" for the KDNode tree, "flat" for the flattened one; same samples.
+              num_threads (int): threads used to build the KD-tree, 0 for all cores; same samples.
           Returns:
-              np.ndarray[int32]: sampled point indices.
+              np.ndarray[int32]: sampled point indices, or (indices, radii, dist_min) with None
+              for the outputs that were not requested.
       )pbdoc");
 
+    m.def("_batch_sampling", &batch_sampling_py, R"pbdoc(
+            Run one FPS engine on every cloud of a batch, spreading the clouds over threads.
+            Args:
+                points (np.ndarray[float32, 3D]): B x N x C point array.
+                n_samples (int): number of samples to pick from every cloud.
+                start_idx (np.ndarray[uint64, 1D]): start index of every cloud, shape (B,).
+                method (str): one of "fps", "fps_kdtree", "npdu", "npdu_morton", "npdu_kdtree", "bucket_kdtree", "bucket_kdline".
+                param (int): window size for the NPDU engines, tree height for "bucket_kdline".
+                num_threads (int): number of threads, 0 for all cores.
+            Returns:
+                np.ndarray[uint64, 2D]: sampled point indices, shape (B, n_samples).
+    )pbdoc");
+
+    m.def("_ragged_sampling", &ragged_sampling_py, R"pbdoc(
+            Run one FPS engine on variable-sized clouds packed into a single array.
+            Args:
+                points (np.ndarray[float32, 2D]): (sum N_i) x C array, clouds stored one after another.
+                offsets (np.ndarray[uint64, 1D]): cloud b is points[offsets[b]:offsets[b + 1]], shape (B + 1,).
+                n_samples (np.ndarray[uint64, 1D]): number of samples of every cloud, shape (B,).
+                start_idx (np.ndarray[uint64, 1D]): start index of every cloud, local to the cloud, shape (B,).
+                method (str): one of "fps", "fps_kdtree", "npdu", "npdu_morton", "npdu_kdtree", "bucket_kdtree", "bucket_kdline".
+                params (np.ndarray[uint64, 1D]): window size (NPDU) or tree height (bucket_kdline) of every cloud, shape (B,).
+                num_threads (int): number of threads, 0 for all cores.
+            Returns:
+                np.ndarray[uint64, 1D]: sampled rows of `points`, cloud after cloud, shape (sum n_samples,).
+    )pbdoc");
+
+    py::class_<FPSSamplerPy>(m, "_FPSSampler", R"pbdoc(
+            FPS state that can be extended with more samples without starting over.
+            Args:
+                points (np.ndarray[float32, 2D]): N x C point array. "fps" reads it in place, the
+                bucket methods copy it into their KD tree.
+                method (str): one of "fps", "bucket_kdtree", "bucket_kdline".
+                start_idx (int): first sample.
+                height (int): tree height for "bucket_kdline", ignored otherwise.
+                num_threads (int): number of threads of "fps", 0 for all cores.
+    )pbdoc")
+        .def(py::init<py::array_t<float, py::array::forcecast>, const std::string&, size_t, size_t, size_t>())
+        .def("next", &FPSSamplerPy::next, R"pbdoc(
+            Take up to k more samples.
+            Args:
+                k (int): number of samples to add.
+            Returns:
+                np.ndarray[uint64]: the new sample indices; shorter than k once all points are taken.
+        )pbdoc")
+        .def("size", &FPSSamplerPy::size, R"pbdoc(
+            Number of samples taken so far.
+        )pbdoc");
+
+    m.def("_simd_isa", []() { return std::string(simd::isa_name(simd::active().isa)); }, R"pbdoc(
+            Name of the instruction set picked at import time for the vanilla FPS kernel.
+            Returns:
+                str: one of "avx512", "avx2", "sse2" or "scalar".
+    )pbdoc");
+
 #ifdef VERSION_INFO
     m.attr("__version__") = MACRO_STRINGIFY(VERSION_INFO);
 #else
@@ -0,0 +1,125 @@
+// Indexed maximum over an array that changes a few entries at a time.
+//
+// The NPDU heuristics only touch k entries of dist_min per iteration, so a
+// full argmax scan would dominate their cost. MaxTree keeps a tournament tree
+// over the array: level 0 holds the winner of every block of kFanout
+// consecutive entries, each level above the winner of kFanout nodes below,
+// so a node's children are one cache line of floats. Changing an entry costs
+// one block rescan plus one rescan per level, and the climb stops as soon as
+// a node's winner is unchanged.
+//
+// Ties go to the smallest index, the same as a `values[i] > max` scan, or
+// with Ties::Last to the largest one, as in a `values[i] >= max` scan.
+
+#ifndef FPSAMPLE_MAX_TREE_HPP
+#define FPSAMPLE_MAX_TREE_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+class MaxTree {
+  public:
+    static constexpr size_t kFanout = 16;
+
+    enum class Ties { First, Last };
+
+    // `values` is read, never written, and must outlive the tree.
+    MaxTree(const float *values, size_t n, Ties ties = Ties::First)
+        : values_(values), n_(n), last_wins_(ties == Ties::Last) {
+        size_t width = n;
+        do {
+            width = (width + kFanout - 1) / kFanout;
+            levels_.emplace_back();
+            levels_.back().val.resize(width);
+            levels_.back().idx.resize(width);
+        } while (width > 1);
+        update_range(0, n);
+    }
+
+    size_t argmax() const { return levels_.back().idx[0]; }
+    float max() const { return levels_.back().val[0]; }
+
+    // values[i] changed.
+    void update(size_t i) {
+        size_t node = i / kFanout;
+        if (!rescan_block(node))
+            return;
+        for (size_t l = 1; l < levels_.size(); ++l) {
+            node /= kFanout;
+            if (!rescan_node(l, node))
+                return;
+        }
+    }
+
+    // Every entry of values[begin, end) may have changed.
+    void update_range(size_t begin, size_t end) {
+        if (begin >= end)
+            return;
+        size_t lo = begin / kFanout, hi = (end - 1) / kFanout;
+        for (size_t b = lo; b <= hi; ++b)
+            rescan_block(b);
+        for (size_t l = 1; l < levels_.size(); ++l) {
+            lo /= kFanout;
+            hi /= kFanout;
+            for (size_t node = lo; node <= hi; ++node)
+                rescan_node(l, node);
+        }
+    }
+
+  private:
+    struct Level {
+        std::vector<float> val;
+        std::vector<size_t> idx;
+    };
+
+    // Both rescans return whether the winner of the node changed.
+    bool rescan_block(size_t b) {
+        const size_t begin = b * kFanout;
+        const size_t end = std::min(begin + kFanout, n_);
+        float best = -1.0f;
+        size_t best_idx = begin;
+        for (size_t i = begin; i < end; ++i) {
+            if (wins(values_[i], best)) {
+                best = values_[i];
+                best_idx = i;
+            }
+        }
+        return store(levels_[0], b, best, best_idx);
+    }
+
+    bool rescan_node(size_t l, size_t node) {
+        const Level &below = levels_[l - 1];
+        const size_t begin = node * kFanout;
+        const size_t end = std::min(begin + kFanout, below.val.size());
+        float best = -1.0f;
+        size_t best_idx = below.idx[begin];
+        for (size_t c = begin; c < end; ++c) {
+            if (wins(below.val[c], best)) {
+                best = below.val[c];
+                best_idx = below.idx[c];
+            }
+        }
+        return store(levels_[l], node, best, best_idx);
+    }
+
+    // Candidates are scanned in index order.
+    bool wins(float val, float best) const {
+        return val > best || (last_wins_ && val == best);
+    }
+
+    static bool store(Level &level, size_t node, float val, size_t idx) {
+        if (level.val[node] == val && level.idx[node] == idx)
+            return false;
+        level.val[node] = val;
+        level.idx[node] = idx;
+        return true;
+    }
+
+    const float *values_;
+    size_t n_;
+    bool last_wins_;
+    std::vector<Level> levels_;
+};
+
+#endif // FPSAMPLE_MAX_TREE_HPP
@@ -0,0 +1,94 @@
+// Morton (Z-order) sorting of a point cloud.
+//
+// Each coordinate is quantized over the bounding box of the cloud and the
+// bits of all coordinates are interleaved into one 64-bit code, so points
+// that are close along the curve are close in space. The codes are sorted
+// with an LSD radix sort, which only runs the passes needed for the bits
+// actually used, so the whole ordering is O(P) for a fixed dimension.
+
+#ifndef FPSAMPLE_MORTON_HPP
+#define FPSAMPLE_MORTON_HPP
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace morton {
+
+// At most this many bits per coordinate; beyond float precision more bits
+// would only split identical values.
+constexpr size_t kMaxBitsPerDim = 21;
+
+// Morton codes of the rows of a row-major P x C buffer. Only the first 64
+// coordinates take part when C > 64.
+inline std::vector<uint64_t> codes(const float *data, size_t P, size_t C,
+                                   size_t *n_bits) {
+    const size_t dims = std::min<size_t>(C, 64);
+    const size_t bits = std::min(kMaxBitsPerDim, 64 / dims);
+    *n_bits = bits * dims;
+
+    std::vector<float> lo(dims, 0.0f), scale(dims, 0.0f);
+    for (size_t j = 0; j < dims && P > 0; ++j) {
+        float mn = data[j], mx = data[j];
+        for (size_t i = 1; i < P; ++i) {
+            mn = std::min(mn, data[i * C + j]);
+            mx = std::max(mx, data[i * C + j]);
+        }
+        lo[j] = mn;
+        if (mx > mn)
+            scale[j] = static_cast<float>((uint64_t(1) << bits) - 1) / (mx - mn);
+    }
+
+    const float top = static_cast<float>((uint64_t(1) << bits) - 1);
+    std::vector<uint64_t> out(P);
+    std::array<uint32_t, 64> q;
+    for (size_t i = 0; i < P; ++i) {
+        const float *row = data + i * C;
+        for (size_t j = 0; j < dims; ++j) {
+            float v = (row[j] - lo[j]) * scale[j];
+            // also maps NaN to 0
+            v = v > 0.0f ? std::min(v, top) : 0.0f;
+            q[j] = static_cast<uint32_t>(v);
+        }
+        uint64_t code = 0;
+        for (size_t b = bits; b-- > 0;)
+            for (size_t j = 0; j < dims; ++j)
+                code = (code << 1) | ((q[j] >> b) & 1u);
+        out[i] = code;
+    }
+    return out;
+}
+
+// Row indices of the cloud in Morton order: order[r] is the row at rank r.
+// The sort is stable, so rows with equal codes keep their input order.
+inline std::vector<size_t> order(const float *data, size_t P, size_t C) {
+    size_t n_bits;
+    std::vector<uint64_t> key = codes(data, P, C, &n_bits);
+    std::vector<size_t> idx(P);
+    for (size_t i = 0; i < P; ++i)
+        idx[i] = i;
+
+    std::vector<uint64_t> key_tmp(P);
+    std::vector<size_t> idx_tmp(P);
+    for (size_t shift = 0; shift < n_bits; shift += 8) {
+        std::array<size_t, 257> count{};
+        for (size_t i = 0; i < P; ++i)
+            ++count[((key[i] >> shift) & 0xff) + 1];
+        for (size_t d = 0; d < 256; ++d)
+            count[d + 1] += count[d];
+        for (size_t i = 0; i < P; ++i) {
+            size_t dst = count[(key[i] >> shift) & 0xff]++;
+            key_tmp[dst] = key[i];
+            idx_tmp[dst] = idx[i];
+        }
+        key.swap(key_tmp);
+        idx.swap(idx_tmp);
+    }
+    return idx;
+}
+
+} // namespace morton
+
+#endif // FPSAMPLE_MORTON_HPP
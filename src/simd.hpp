@@ -0,0 +1,875 @@
+// Runtime-dispatched SIMD kernels for the vanilla FPS inner loop.
+//
+// The vanilla FPS iteration is "refresh dist_min against the last selected
+// point, then take the argmax of dist_min". The kernels below fuse both into a
+// single streaming pass, so every point and every dist_min entry is touched
+// exactly once per iteration. A second family of kernels (`update_min`) folds
+// a whole set of reference points into dist_min in one pass, for seeding FPS
+// from several start indices, and can take the argmax on the way
+// (`update_min_argmax`) for the buckets of the KD tree samplers. Row-major
+// (AoS) and column-major (SoA) clouds each get their own kernel, so neither
+// layout has to be copied into the other.
+//
+// The ISA is chosen once from CPUID (see `active()`); all ISAs produce the same
+// result as the scalar loop, including its tie-breaking (the last index among
+// equal maxima wins, or the first one with `update_argmax_first`).
+
+#ifndef FPSAMPLE_SIMD_HPP
+#define FPSAMPLE_SIMD_HPP
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "dispatch.hpp"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) ||           \
+    defined(_M_IX86)
+#define FPSAMPLE_SIMD_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+#if defined(FPSAMPLE_SIMD_X86) && (defined(__GNUC__) || defined(__clang__))
+#define FPSAMPLE_TARGET(isa) __attribute__((target(isa)))
+#else
+#define FPSAMPLE_TARGET(isa)
+#endif
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#define FPSAMPLE_NOINLINE __declspec(noinline)
+#else
+#define FPSAMPLE_NOINLINE __attribute__((noinline))
+#endif
+
+namespace simd {
+
+enum class Isa { Scalar = 0, SSE2, AVX2, AVX512 };
+
+inline const char *isa_name(Isa isa) {
+    switch (isa) {
+    case Isa::SSE2:
+        return "sse2";
+    case Isa::AVX2:
+        return "avx2";
+    case Isa::AVX512:
+        return "avx512";
+    default:
+        return "scalar";
+    }
+}
+
+struct ArgMax {
+    float val;
+    size_t idx;
+};
+
+// Which index an argmax keeps among equal maxima: the last one, as in a
+// `dist_min[i] >= max_val` scan, or the first one, as in `>`.
+enum class Ties { Last, First };
+
+// The larger distance wins, equal distances go by TIES.
+template <Ties TIES = Ties::Last>
+inline ArgMax merge(const ArgMax &a, const ArgMax &b) {
+    const bool later = b.idx > a.idx;
+    if (b.val > a.val || (b.val == a.val && later == (TIES == Ties::Last)))
+        return b;
+    return a;
+}
+
+enum class Layout { AoS, SoA };
+
+// Read-only view of a P x C float cloud. With AoS (row-major) coordinate j of
+// point i is data[i * stride + j], stride >= C; with SoA (column-major) it is
+// data[j * stride + i], stride >= P.
+struct CloudView {
+    const float *data;
+    size_t P, C, stride;
+    Layout layout;
+
+    float at(size_t i, size_t j) const {
+        return layout == Layout::AoS ? data[i * stride + j]
+                                     : data[j * stride + i];
+    }
+};
+
+// Signature shared by every kernel: update dist_min[begin, end) against `ref`
+// (C floats) and return the argmax of the range.
+using UpdateArgmaxFn = ArgMax (*)(const CloudView &pts, size_t begin,
+                                  size_t end, const float *ref,
+                                  float *dist_min);
+
+// Update dist_min[begin, end) against `n_refs` reference points packed
+// row-major in `refs` (n_refs x C floats). No argmax is taken.
+using UpdateMinFn = void (*)(const CloudView &pts, size_t begin, size_t end,
+                             const float *refs, size_t n_refs,
+                             float *dist_min);
+
+// update_min that also returns the argmax of the updated range.
+using UpdateMinArgmaxFn = ArgMax (*)(const CloudView &pts, size_t begin,
+                                     size_t end, const float *refs,
+                                     size_t n_refs, float *dist_min);
+
+// References are processed in tiles of this many: each coordinate of a block
+// of points is loaded once per tile and feeds one accumulator per reference.
+constexpr size_t kRefTile = 4;
+
+// DIM > 0 fixes the number of coordinates at compile time so the inner loop
+// is fully unrolled; DIM == 0 is the generic fallback that reads pts.C.
+
+// Kept out of line: once inlined into an AVX-512 kernel the compiler may fuse
+// `dist += d * d` into an FMA, and the tail would round differently from the
+// rest of the range.
+template <Layout L, size_t DIM, Ties TIES = Ties::Last>
+FPSAMPLE_NOINLINE ArgMax update_argmax_scalar(const CloudView &pts,
+                                              size_t begin, size_t end,
+                                              const float *ref,
+                                              float *dist_min) {
+    const size_t C = DIM ? DIM : pts.C, s = pts.stride;
+    ArgMax best{-1.0f, 0};
+    for (size_t i = begin; i < end; ++i) {
+        float dist = 0.0f;
+        for (size_t j = 0; j < C; ++j) {
+            float x = (L == Layout::AoS) ? pts.data[i * s + j]
+                                         : pts.data[j * s + i];
+            float d = x - ref[j];
+            dist += d * d;
+        }
+        if (dist < dist_min[i])
+            dist_min[i] = dist;
+        if (TIES == Ties::Last ? dist_min[i] >= best.val
+                               : dist_min[i] > best.val) {
+            best.val = dist_min[i];
+            best.idx = i;
+        }
+    }
+    return best;
+}
+
+// Every distance below is summed in coordinate order with separate multiply
+// and add, exactly as in update_argmax, so folding a set of references in one
+// pass leaves dist_min bit-identical to folding them one at a time.
+//
+// The min_argmax kernels serve both update_min (ARGMAX false) and
+// update_min_argmax, which also returns the argmax of the updated range with
+// the first index winning ties.
+template <Layout L, size_t DIM, bool ARGMAX>
+FPSAMPLE_NOINLINE ArgMax min_argmax_scalar(const CloudView &pts, size_t begin,
+                                           size_t end, const float *refs,
+                                           size_t n_refs, float *dist_min) {
+    const size_t C = DIM ? DIM : pts.C, s = pts.stride;
+    ArgMax top{-1.0f, 0};
+    for (size_t i = begin; i < end; ++i) {
+        float best = dist_min[i];
+        for (size_t r = 0; r < n_refs; ++r) {
+            const float *ref = refs + r * C;
+            float dist = 0.0f;
+            for (size_t j = 0; j < C; ++j) {
+                float x = (L == Layout::AoS) ? pts.data[i * s + j]
+                                             : pts.data[j * s + i];
+                float d = x - ref[j];
+                dist += d * d;
+            }
+            if (dist < best)
+                best = dist;
+        }
+        dist_min[i] = best;
+        if (ARGMAX && best > top.val) {
+            top.val = best;
+            top.idx = i;
+        }
+    }
+    return top;
+}
+
+template <Layout L, size_t DIM>
+void update_min_scalar(const CloudView &pts, size_t begin, size_t end,
+                       const float *refs, size_t n_refs, float *dist_min) {
+    min_argmax_scalar<L, DIM, false>(pts, begin, end, refs, n_refs, dist_min);
+}
+
+#ifdef FPSAMPLE_SIMD_X86
+
+// Lane indices are kept as int32 offsets from `begin`; `update_argmax` splits
+// larger ranges so they never overflow.
+template <size_t W, Ties TIES>
+inline ArgMax reduce_lanes(const float *vals, const int32_t *idxs,
+                           size_t begin) {
+    ArgMax best{-1.0f, 0};
+    for (size_t k = 0; k < W; ++k) {
+        best = merge<TIES>(best,
+                           {vals[k], begin + static_cast<uint32_t>(idxs[k])});
+    }
+    return best;
+}
+
+// In the kernels below AoS loads pick one coordinate out of W consecutive
+// rows, SoA loads read W consecutive entries of one column.
+
+template <Layout L, size_t DIM, Ties TIES = Ties::Last>
+FPSAMPLE_TARGET("sse2")
+ArgMax update_argmax_sse2(const CloudView &pts, size_t begin, size_t end,
+                          const float *ref, float *dist_min) {
+    const size_t C = DIM ? DIM : pts.C, s = pts.stride;
+    ArgMax best{-1.0f, 0};
+    size_t i = begin;
+    if (end - begin >= 4) {
+        __m128 vmax = _mm_set1_ps(-1.0f);
+        __m128i vbest = _mm_setzero_si128();
+        __m128i vcur = _mm_setr_epi32(0, 1, 2, 3);
+        const __m128i step = _mm_set1_epi32(4);
+        for (; i + 4 <= end; i += 4) {
+            __m128 dist = _mm_setzero_ps();
+            for (size_t j = 0; j < C; ++j) {
+                __m128 x;
+                if constexpr (L == Layout::AoS) {
+                    const float *p = pts.data + i * s + j;
+                    x = _mm_setr_ps(p[0], p[s], p[2 * s], p[3 * s]);
+                } else {
+                    x = _mm_loadu_ps(pts.data + j * s + i);
+                }
+                __m128 d = _mm_sub_ps(x, _mm_set1_ps(ref[j]));
+                dist = _mm_add_ps(dist, _mm_mul_ps(d, d));
+            }
+            __m128 nd = _mm_min_ps(dist, _mm_loadu_ps(dist_min + i));
+            _mm_storeu_ps(dist_min + i, nd);
+            __m128 ge = TIES == Ties::Last ? _mm_cmpge_ps(nd, vmax)
+                                           : _mm_cmpgt_ps(nd, vmax);
+            __m128i gei = _mm_castps_si128(ge);
+            vmax = _mm_or_ps(_mm_and_ps(ge, nd), _mm_andnot_ps(ge, vmax));
+            vbest = _mm_or_si128(_mm_and_si128(gei, vcur),
+                                 _mm_andnot_si128(gei, vbest));
+            vcur = _mm_add_epi32(vcur, step);
+        }
+        alignas(16) float mv[4];
+        alignas(16) int32_t mi[4];
+        _mm_store_ps(mv, vmax);
+        _mm_store_si128(reinterpret_cast<__m128i *>(mi), vbest);
+        best = reduce_lanes<4, TIES>(mv, mi, begin);
+    }
+    return merge<TIES>(
+        best, update_argmax_scalar<L, DIM, TIES>(pts, i, end, ref, dist_min));
+}
+
+template <Layout L, size_t DIM, Ties TIES = Ties::Last>
+FPSAMPLE_TARGET("avx2")
+ArgMax update_argmax_avx2(const CloudView &pts, size_t begin, size_t end,
+                          const float *ref, float *dist_min) {
+    const size_t C = DIM ? DIM : pts.C, s = pts.stride;
+    ArgMax best{-1.0f, 0};
+    size_t i = begin;
+    if (end - begin >= 8) {
+        __m256 vmax = _mm256_set1_ps(-1.0f);
+        __m256i vbest = _mm256_setzero_si256();
+        __m256i vcur = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+        const __m256i step = _mm256_set1_epi32(8);
+        for (; i + 8 <= end; i += 8) {
+            __m256 dist = _mm256_setzero_ps();
+            for (size_t j = 0; j < C; ++j) {
+                __m256 x;
+                if constexpr (L == Layout::AoS) {
+                    // AVX2 gathers are slower than scalar inserts on most
+                    // cores
+                    const float *p = pts.data + i * s + j;
+                    x = _mm256_setr_ps(p[0], p[s], p[2 * s], p[3 * s],
+                                       p[4 * s], p[5 * s], p[6 * s],
+                                       p[7 * s]);
+                } else {
+                    x = _mm256_loadu_ps(pts.data + j * s + i);
+                }
+                __m256 d = _mm256_sub_ps(x, _mm256_set1_ps(ref[j]));
+                dist = _mm256_add_ps(dist, _mm256_mul_ps(d, d));
+            }
+            __m256 nd = _mm256_min_ps(dist, _mm256_loadu_ps(dist_min + i));
+            _mm256_storeu_ps(dist_min + i, nd);
+            constexpr int kCmp = TIES == Ties::Last ? _CMP_GE_OQ : _CMP_GT_OQ;
+            __m256 ge = _mm256_cmp_ps(nd, vmax, kCmp);
+            vmax = _mm256_blendv_ps(vmax, nd, ge);
+            vbest = _mm256_castps_si256(_mm256_blendv_ps(
+                _mm256_castsi256_ps(vbest), _mm256_castsi256_ps(vcur), ge));
+            vcur = _mm256_add_epi32(vcur, step);
+        }
+        alignas(32) float mv[8];
+        alignas(32) int32_t mi[8];
+        _mm256_store_ps(mv, vmax);
+        _mm256_store_si256(reinterpret_cast<__m256i *>(mi), vbest);
+        best = reduce_lanes<8, TIES>(mv, mi, begin);
+    }
+    return merge<TIES>(
+        best, update_argmax_scalar<L, DIM, TIES>(pts, i, end, ref, dist_min));
+}
+
+// The AoS gathers of the AVX-512 kernels take lane * stride as int32
+// offsets. Rows further apart than this would overflow them, so those clouds
+// take the scalar loop instead.
+constexpr size_t kMaxGatherStride = INT32_MAX / 15;
+
+template <Layout L, size_t DIM, Ties TIES = Ties::Last>
+FPSAMPLE_TARGET("avx512f")
+ArgMax update_argmax_avx512(const CloudView &pts, size_t begin, size_t end,
+                            const float *ref, float *dist_min) {
+    const size_t C = DIM ? DIM : pts.C, s = pts.stride;
+    if (L == Layout::AoS && s > kMaxGatherStride)
+        return update_argmax_scalar<L, DIM, TIES>(pts, begin, end, ref,
+                                                  dist_min);
+    ArgMax best{-1.0f, 0};
+    size_t i = begin;
+    if (end - begin >= 16) {
+        const __m512i lane = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9,
+                                               10, 11, 12, 13, 14, 15);
+        const __m512i offs =
+            _mm512_mullo_epi32(lane, _mm512_set1_epi32(static_cast<int>(s)));
+        __m512 vmax = _mm512_set1_ps(-1.0f);
+        __m512i vbest = _mm512_setzero_si512();
+        __m512i vcur = lane;
+        const __m512i step = _mm512_set1_epi32(16);
+        for (; i + 16 <= end; i += 16) {
+            __m512 dist = _mm512_setzero_ps();
+            for (size_t j = 0; j < C; ++j) {
+                __m512 x;
+                if constexpr (L == Layout::AoS) {
+                    x = _mm512_i32gather_ps(offs, pts.data + i * s + j, 4);
+                } else {
+                    x = _mm512_loadu_ps(pts.data + j * s + i);
+                }
+                __m512 d = _mm512_sub_ps(x, _mm512_set1_ps(ref[j]));
+                // explicit rounding forms: AVX-512 implies FMA and the plain
+                // mul/add pair could be contracted into one fused op
+                dist = _mm512_add_round_ps(
+                    dist, _mm512_mul_round_ps(d, d, _MM_FROUND_CUR_DIRECTION),
+                    _MM_FROUND_CUR_DIRECTION);
+            }
+            __m512 nd = _mm512_min_ps(dist, _mm512_loadu_ps(dist_min + i));
+            _mm512_storeu_ps(dist_min + i, nd);
+            constexpr int kCmp = TIES == Ties::Last ? _CMP_GE_OQ : _CMP_GT_OQ;
+            __mmask16 ge = _mm512_cmp_ps_mask(nd, vmax, kCmp);
+            vmax = _mm512_mask_mov_ps(vmax, ge, nd);
+            vbest = _mm512_mask_mov_epi32(vbest, ge, vcur);
+            vcur = _mm512_add_epi32(vcur, step);
+        }
+        alignas(64) float mv[16];
+        alignas(64) int32_t mi[16];
+        _mm512_store_ps(mv, vmax);
+        _mm512_store_si512(mi, vbest);
+        best = reduce_lanes<16, TIES>(mv, mi, begin);
+    }
+    return merge<TIES>(
+        best, update_argmax_scalar<L, DIM, TIES>(pts, i, end, ref, dist_min));
+}
+
+// Coordinate j of the points starting at row i, one per lane.
+template <Layout L>
+FPSAMPLE_TARGET("sse2")
+inline __m128 load_lanes_sse2(const CloudView &pts, size_t i, size_t j) {
+    const size_t s = pts.stride;
+    if constexpr (L == Layout::AoS) {
+        const float *p = pts.data + i * s + j;
+        return _mm_setr_ps(p[0], p[s], p[2 * s], p[3 * s]);
+    } else {
+        return _mm_loadu_ps(pts.data + j * s + i);
+    }
+}
+
+template <Layout L>
+FPSAMPLE_TARGET("avx2")
+inline __m256 load_lanes_avx2(const CloudView &pts, size_t i, size_t j) {
+    const size_t s = pts.stride;
+    if constexpr (L == Layout::AoS) {
+        const float *p = pts.data + i * s + j;
+        return _mm256_setr_ps(p[0], p[s], p[2 * s], p[3 * s], p[4 * s],
+                              p[5 * s], p[6 * s], p[7 * s]);
+    } else {
+        return _mm256_loadu_ps(pts.data + j * s + i);
+    }
+}
+
+// `offs` holds lane * stride, used for the AoS gather.
+template <Layout L>
+FPSAMPLE_TARGET("avx512f")
+inline __m512 load_lanes_avx512(const CloudView &pts, __m512i offs, size_t i,
+                                size_t j) {
+    if constexpr (L == Layout::AoS) {
+        return _mm512_i32gather_ps(offs, pts.data + i * pts.stride + j, 4);
+    } else {
+        (void)offs;
+        return _mm512_loadu_ps(pts.data + j * pts.stride + i);
+    }
+}
+
+// acc + d * d without FMA contraction, see update_argmax_avx512.
+FPSAMPLE_TARGET("avx512f")
+inline __m512 sq_add_avx512(__m512 acc, __m512 d) {
+    return _mm512_add_round_ps(
+        acc, _mm512_mul_round_ps(d, d, _MM_FROUND_CUR_DIRECTION),
+        _MM_FROUND_CUR_DIRECTION);
+}
+
+template <Layout L, size_t DIM, bool ARGMAX>
+FPSAMPLE_TARGET("sse2")
+ArgMax min_argmax_sse2(const CloudView &pts, size_t begin, size_t end,
+                       const float *refs, size_t n_refs, float *dist_min) {
+    const size_t C = DIM ? DIM : pts.C;
+    const size_t n_tiled = n_refs / kRefTile * kRefTile;
+    __m128 vmax = _mm_set1_ps(-1.0f);
+    __m128i vbest = _mm_setzero_si128();
+    __m128i vcur = _mm_setr_epi32(0, 1, 2, 3);
+    size_t i = begin;
+    for (; i + 4 <= end; i += 4) {
+        __m128 vmin = _mm_loadu_ps(dist_min + i);
+        size_t r = 0;
+        for (; r < n_tiled; r += kRefTile) {
+            const float *ref = refs + r * C;
+            __m128 acc[kRefTile];
+            for (size_t t = 0; t < kRefTile; ++t)
+                acc[t] = _mm_setzero_ps();
+            for (size_t j = 0; j < C; ++j) {
+                __m128 x = load_lanes_sse2<L>(pts, i, j);
+                for (size_t t = 0; t < kRefTile; ++t) {
+                    __m128 d = _mm_sub_ps(x, _mm_set1_ps(ref[t * C + j]));
+                    acc[t] = _mm_add_ps(acc[t], _mm_mul_ps(d, d));
+                }
+            }
+            for (size_t t = 0; t < kRefTile; ++t)
+                vmin = _mm_min_ps(acc[t], vmin);
+        }
+        for (; r < n_refs; ++r) {
+            const float *ref = refs + r * C;
+            __m128 dist = _mm_setzero_ps();
+            for (size_t j = 0; j < C; ++j) {
+                __m128 d = _mm_sub_ps(load_lanes_sse2<L>(pts, i, j),
+                                      _mm_set1_ps(ref[j]));
+                dist = _mm_add_ps(dist, _mm_mul_ps(d, d));
+            }
+            vmin = _mm_min_ps(dist, vmin);
+        }
+        _mm_storeu_ps(dist_min + i, vmin);
+        if constexpr (ARGMAX) {
+            __m128 gt = _mm_cmpgt_ps(vmin, vmax);
+            __m128i gti = _mm_castps_si128(gt);
+            vmax = _mm_or_ps(_mm_and_ps(gt, vmin), _mm_andnot_ps(gt, vmax));
+            vbest = _mm_or_si128(_mm_and_si128(gti, vcur),
+                                 _mm_andnot_si128(gti, vbest));
+            vcur = _mm_add_epi32(vcur, _mm_set1_epi32(4));
+        }
+    }
+    ArgMax best{-1.0f, 0};
+    if constexpr (ARGMAX) {
+        alignas(16) float mv[4];
+        alignas(16) int32_t mi[4];
+        _mm_store_ps(mv, vmax);
+        _mm_store_si128(reinterpret_cast<__m128i *>(mi), vbest);
+        best = reduce_lanes<4, Ties::First>(mv, mi, begin);
+    }
+    return merge<Ties::First>(best, min_argmax_scalar<L, DIM, ARGMAX>(
+                                        pts, i, end, refs, n_refs, dist_min));
+}
+
+template <Layout L, size_t DIM>
+FPSAMPLE_TARGET("sse2")
+void update_min_sse2(const CloudView &pts, size_t begin, size_t end,
+                     const float *refs, size_t n_refs, float *dist_min) {
+    min_argmax_sse2<L, DIM, false>(pts, begin, end, refs, n_refs, dist_min);
+}
+
+template <Layout L, size_t DIM, bool ARGMAX>
+FPSAMPLE_TARGET("avx2")
+ArgMax min_argmax_avx2(const CloudView &pts, size_t begin, size_t end,
+                       const float *refs, size_t n_refs, float *dist_min) {
+    const size_t C = DIM ? DIM : pts.C;
+    const size_t n_tiled = n_refs / kRefTile * kRefTile;
+    __m256 vmax = _mm256_set1_ps(-1.0f);
+    __m256i vbest = _mm256_setzero_si256();
+    __m256i vcur = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    size_t i = begin;
+    for (; i + 8 <= end; i += 8) {
+        __m256 vmin = _mm256_loadu_ps(dist_min + i);
+        size_t r = 0;
+        for (; r < n_tiled; r += kRefTile) {
+            const float *ref = refs + r * C;
+            __m256 acc[kRefTile];
+            for (size_t t = 0; t < kRefTile; ++t)
+                acc[t] = _mm256_setzero_ps();
+            for (size_t j = 0; j < C; ++j) {
+                __m256 x = load_lanes_avx2<L>(pts, i, j);
+                for (size_t t = 0; t < kRefTile; ++t) {
+                    __m256 d =
+                        _mm256_sub_ps(x, _mm256_set1_ps(ref[t * C + j]));
+                    acc[t] = _mm256_add_ps(acc[t], _mm256_mul_ps(d, d));
+                }
+            }
+            for (size_t t = 0; t < kRefTile; ++t)
+                vmin = _mm256_min_ps(acc[t], vmin);
+        }
+        for (; r < n_refs; ++r) {
+            const float *ref = refs + r * C;
+            __m256 dist = _mm256_setzero_ps();
+            for (size_t j = 0; j < C; ++j) {
+                __m256 d = _mm256_sub_ps(load_lanes_avx2<L>(pts, i, j),
+                                         _mm256_set1_ps(ref[j]));
+                dist = _mm256_add_ps(dist, _mm256_mul_ps(d, d));
+            }
+            vmin = _mm256_min_ps(dist, vmin);
+        }
+        _mm256_storeu_ps(dist_min + i, vmin);
+        if constexpr (ARGMAX) {
+            __m256 gt = _mm256_cmp_ps(vmin, vmax, _CMP_GT_OQ);
+            vmax = _mm256_blendv_ps(vmax, vmin, gt);
+            vbest = _mm256_castps_si256(_mm256_blendv_ps(
+                _mm256_castsi256_ps(vbest), _mm256_castsi256_ps(vcur), gt));
+            vcur = _mm256_add_epi32(vcur, _mm256_set1_epi32(8));
+        }
+    }
+    ArgMax best{-1.0f, 0};
+    if constexpr (ARGMAX) {
+        alignas(32) float mv[8];
+        alignas(32) int32_t mi[8];
+        _mm256_store_ps(mv, vmax);
+        _mm256_store_si256(reinterpret_cast<__m256i *>(mi), vbest);
+        best = reduce_lanes<8, Ties::First>(mv, mi, begin);
+    }
+    return merge<Ties::First>(best, min_argmax_scalar<L, DIM, ARGMAX>(
+                                        pts, i, end, refs, n_refs, dist_min));
+}
+
+template <Layout L, size_t DIM>
+FPSAMPLE_TARGET("avx2")
+void update_min_avx2(const CloudView &pts, size_t begin, size_t end,
+                     const float *refs, size_t n_refs, float *dist_min) {
+    min_argmax_avx2<L, DIM, false>(pts, begin, end, refs, n_refs, dist_min);
+}
+
+template <Layout L, size_t DIM, bool ARGMAX>
+FPSAMPLE_TARGET("avx512f")
+ArgMax min_argmax_avx512(const CloudView &pts, size_t begin, size_t end,
+                         const float *refs, size_t n_refs, float *dist_min) {
+    const size_t C = DIM ? DIM : pts.C, s = pts.stride;
+    if (L == Layout::AoS && s > kMaxGatherStride)
+        return min_argmax_scalar<L, DIM, ARGMAX>(pts, begin, end, refs, n_refs,
+                                                 dist_min);
+    const size_t n_tiled = n_refs / kRefTile * kRefTile;
+    const __m512i lane = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10,
+                                           11, 12, 13, 14, 15);
+    const __m512i offs =
+        _mm512_mullo_epi32(lane, _mm512_set1_epi32(static_cast<int>(s)));
+    __m512 vmax = _mm512_set1_ps(-1.0f);
+    __m512i vbest = _mm512_setzero_si512();
+    __m512i vcur = lane;
+    size_t i = begin;
+    for (; i + 16 <= end; i += 16) {
+        __m512 vmin = _mm512_loadu_ps(dist_min + i);
+        size_t r = 0;
+        for (; r < n_tiled; r += kRefTile) {
+            const float *ref = refs + r * C;
+            __m512 acc[kRefTile];
+            for (size_t t = 0; t < kRefTile; ++t)
+                acc[t] = _mm512_setzero_ps();
+            for (size_t j = 0; j < C; ++j) {
+                __m512 x = load_lanes_avx512<L>(pts, offs, i, j);
+                for (size_t t = 0; t < kRefTile; ++t)
+                    acc[t] = sq_add_avx512(
+                        acc[t],
+                        _mm512_sub_ps(x, _mm512_set1_ps(ref[t * C + j])));
+            }
+            for (size_t t = 0; t < kRefTile; ++t)
+                vmin = _mm512_min_ps(acc[t], vmin);
+        }
+        for (; r < n_refs; ++r) {
+            const float *ref = refs + r * C;
+            __m512 dist = _mm512_setzero_ps();
+            for (size_t j = 0; j < C; ++j)
+                dist = sq_add_avx512(
+                    dist, _mm512_sub_ps(load_lanes_avx512<L>(pts, offs, i, j),
+                                        _mm512_set1_ps(ref[j])));
+            vmin = _mm512_min_ps(dist, vmin);
+        }
+        _mm512_storeu_ps(dist_min + i, vmin);
+        if constexpr (ARGMAX) {
+            __mmask16 gt = _mm512_cmp_ps_mask(vmin, vmax, _CMP_GT_OQ);
+            vmax = _mm512_mask_mov_ps(vmax, gt, vmin);
+            vbest = _mm512_mask_mov_epi32(vbest, gt, vcur);
+            vcur = _mm512_add_epi32(vcur, _mm512_set1_epi32(16));
+        }
+    }
+    ArgMax best{-1.0f, 0};
+    if constexpr (ARGMAX) {
+        alignas(64) float mv[16];
+        alignas(64) int32_t mi[16];
+        _mm512_store_ps(mv, vmax);
+        _mm512_store_si512(mi, vbest);
+        best = reduce_lanes<16, Ties::First>(mv, mi, begin);
+    }
+    return merge<Ties::First>(best, min_argmax_scalar<L, DIM, ARGMAX>(
+                                        pts, i, end, refs, n_refs, dist_min));
+}
+
+template <Layout L, size_t DIM>
+FPSAMPLE_TARGET("avx512f")
+void update_min_avx512(const CloudView &pts, size_t begin, size_t end,
+                       const float *refs, size_t n_refs, float *dist_min) {
+    min_argmax_avx512<L, DIM, false>(pts, begin, end, refs, n_refs, dist_min);
+}
+
+inline void cpuid(int leaf, int subleaf, uint32_t regs[4]) {
+#if defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuidex(info, leaf, subleaf);
+    for (int k = 0; k < 4; ++k)
+        regs[k] = static_cast<uint32_t>(info[k]);
+#else
+    __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+inline uint64_t xgetbv0() {
+#if defined(_MSC_VER) && !defined(__clang__)
+    return _xgetbv(0);
+#else
+    uint32_t eax, edx;
+    __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return (static_cast<uint64_t>(edx) << 32) | eax;
+#endif
+}
+
+#endif // FPSAMPLE_SIMD_X86
+
+// Best ISA supported by both the CPU and the OS (AVX state must be enabled in
+// XCR0, otherwise the wide registers are not preserved across context
+// switches).
+inline Isa detect_isa() {
+#ifdef FPSAMPLE_SIMD_X86
+    uint32_t r[4];
+    cpuid(0, 0, r);
+    const uint32_t max_leaf = r[0];
+    cpuid(1, 0, r);
+    const bool sse2 = (r[3] >> 26) & 1;
+    const bool osxsave = (r[2] >> 27) & 1;
+    const bool avx = (r[2] >> 28) & 1;
+    if (!sse2)
+        return Isa::Scalar;
+
+    const uint64_t xcr0 = osxsave ? xgetbv0() : 0;
+    const bool ymm_state = (xcr0 & 0x6) == 0x6;
+    const bool zmm_state = (xcr0 & 0xe6) == 0xe6;
+
+    bool avx2 = false, avx512f = false;
+    if (max_leaf >= 7) {
+        cpuid(7, 0, r);
+        avx2 = (r[1] >> 5) & 1;
+        avx512f = (r[1] >> 16) & 1;
+    }
+    if (avx && avx512f && zmm_state)
+        return Isa::AVX512;
+    if (avx && avx2 && ymm_state)
+        return Isa::AVX2;
+    return Isa::SSE2;
+#else
+    return Isa::Scalar;
+#endif
+}
+
+template <Layout L, size_t DIM, Ties TIES = Ties::Last>
+UpdateArgmaxFn update_argmax_kernel(Isa isa) {
+#ifdef FPSAMPLE_SIMD_X86
+    switch (isa) {
+    case Isa::AVX512:
+        return &update_argmax_avx512<L, DIM, TIES>;
+    case Isa::AVX2:
+        return &update_argmax_avx2<L, DIM, TIES>;
+    case Isa::SSE2:
+        return &update_argmax_sse2<L, DIM, TIES>;
+    default:
+        break;
+    }
+#else
+    (void)isa;
+#endif
+    return &update_argmax_scalar<L, DIM, TIES>;
+}
+
+template <Layout L, size_t DIM> UpdateMinFn update_min_kernel(Isa isa) {
+#ifdef FPSAMPLE_SIMD_X86
+    switch (isa) {
+    case Isa::AVX512:
+        return &update_min_avx512<L, DIM>;
+    case Isa::AVX2:
+        return &update_min_avx2<L, DIM>;
+    case Isa::SSE2:
+        return &update_min_sse2<L, DIM>;
+    default:
+        break;
+    }
+#else
+    (void)isa;
+#endif
+    return &update_min_scalar<L, DIM>;
+}
+
+template <Layout L, size_t DIM>
+UpdateMinArgmaxFn update_min_argmax_kernel(Isa isa) {
+#ifdef FPSAMPLE_SIMD_X86
+    switch (isa) {
+    case Isa::AVX512:
+        return &min_argmax_avx512<L, DIM, true>;
+    case Isa::AVX2:
+        return &min_argmax_avx2<L, DIM, true>;
+    case Isa::SSE2:
+        return &min_argmax_sse2<L, DIM, true>;
+    default:
+        break;
+    }
+#else
+    (void)isa;
+#endif
+    return &min_argmax_scalar<L, DIM, true>;
+}
+
+// Dimensions with a dedicated, fully unrolled kernel; wider clouds use the
+// generic one.
+constexpr size_t kMaxFixedDim = 8;
+using UpdateArgmaxTable = std::array<UpdateArgmaxFn, kMaxFixedDim + 1>;
+using UpdateMinTable = std::array<UpdateMinFn, kMaxFixedDim + 1>;
+using UpdateMinArgmaxTable = std::array<UpdateMinArgmaxFn, kMaxFixedDim + 1>;
+
+template <Layout L, Ties TIES> struct update_argmax_func_helper {
+    Isa isa;
+    template <size_t DIM> UpdateArgmaxFn operator()() {
+        return update_argmax_kernel<L, DIM, TIES>(isa);
+    }
+};
+
+// Entry 0 is the generic kernel, entry d the one specialized for d columns.
+template <Layout L, Ties TIES = Ties::Last>
+UpdateArgmaxTable update_argmax_table(Isa isa) {
+    auto fixed = map<UpdateArgmaxFn, kMaxFixedDim>(
+        update_argmax_func_helper<L, TIES>{isa});
+    UpdateArgmaxTable table;
+    table[0] = update_argmax_kernel<L, 0, TIES>(isa);
+    std::copy(fixed.begin(), fixed.end(), table.begin() + 1);
+    return table;
+}
+
+template <Layout L> struct update_min_func_helper {
+    Isa isa;
+    template <size_t DIM> UpdateMinFn operator()() {
+        return update_min_kernel<L, DIM>(isa);
+    }
+};
+
+template <Layout L> UpdateMinTable update_min_table(Isa isa) {
+    auto fixed = map<UpdateMinFn, kMaxFixedDim>(update_min_func_helper<L>{isa});
+    UpdateMinTable table;
+    table[0] = update_min_kernel<L, 0>(isa);
+    std::copy(fixed.begin(), fixed.end(), table.begin() + 1);
+    return table;
+}
+
+template <Layout L> struct update_min_argmax_func_helper {
+    Isa isa;
+    template <size_t DIM> UpdateMinArgmaxFn operator()() {
+        return update_min_argmax_kernel<L, DIM>(isa);
+    }
+};
+
+template <Layout L> UpdateMinArgmaxTable update_min_argmax_table(Isa isa) {
+    auto fixed = map<UpdateMinArgmaxFn, kMaxFixedDim>(
+        update_min_argmax_func_helper<L>{isa});
+    UpdateMinArgmaxTable table;
+    table[0] = update_min_argmax_kernel<L, 0>(isa);
+    std::copy(fixed.begin(), fixed.end(), table.begin() + 1);
+    return table;
+}
+
+struct Dispatch {
+    Isa isa;
+    UpdateArgmaxTable update_argmax_aos;
+    UpdateArgmaxTable update_argmax_soa;
+    UpdateArgmaxTable update_argmax_soa_first;
+    UpdateMinTable update_min_aos;
+    UpdateMinTable update_min_soa;
+    UpdateMinArgmaxTable update_min_argmax_soa;
+};
+
+// Selected once (the module calls this at import time) and read-only after.
+inline const Dispatch &active() {
+    static const Dispatch d = [] {
+        Isa isa = detect_isa();
+        return Dispatch{isa,
+                        update_argmax_table<Layout::AoS>(isa),
+                        update_argmax_table<Layout::SoA>(isa),
+                        update_argmax_table<Layout::SoA, Ties::First>(isa),
+                        update_min_table<Layout::AoS>(isa),
+                        update_min_table<Layout::SoA>(isa),
+                        update_min_argmax_table<Layout::SoA>(isa)};
+    }();
+    return d;
+}
+
+// Fused dist_min update + argmax over [begin, end) with the active kernel for
+// the layout and dimension of `pts`.
+inline ArgMax update_argmax(const CloudView &pts, size_t begin, size_t end,
+                            const float *ref, float *dist_min) {
+    constexpr size_t kBlock = size_t(1) << 30;
+    const UpdateArgmaxTable &table = pts.layout == Layout::AoS
+                                         ? active().update_argmax_aos
+                                         : active().update_argmax_soa;
+    const UpdateArgmaxFn fn = table[pts.C <= kMaxFixedDim ? pts.C : 0];
+    ArgMax best{-1.0f, 0};
+    for (size_t lo = begin; lo < end; lo += kBlock) {
+        size_t hi = (end - lo > kBlock) ? lo + kBlock : end;
+        best = merge(best, fn(pts, lo, hi, ref, dist_min));
+    }
+    return best;
+}
+
+// update_argmax for SoA clouds, keeping the first index among equal maxima
+// as the bucket KD trees do.
+inline ArgMax update_argmax_first(const CloudView &pts, size_t begin,
+                                  size_t end, const float *ref,
+                                  float *dist_min) {
+    constexpr size_t kBlock = size_t(1) << 30;
+    const UpdateArgmaxFn fn = active().update_argmax_soa_first
+        [pts.C <= kMaxFixedDim ? pts.C : 0];
+    ArgMax best{-1.0f, 0};
+    for (size_t lo = begin; lo < end; lo += kBlock) {
+        size_t hi = (end - lo > kBlock) ? lo + kBlock : end;
+        best = merge<Ties::First>(best, fn(pts, lo, hi, ref, dist_min));
+    }
+    return best;
+}
+
+// dist_min[begin, end) = min(dist_min, distance to each of the `n_refs`
+// points in `refs`), in a single pass over the range.
+inline void update_min(const CloudView &pts, size_t begin, size_t end,
+                       const float *refs, size_t n_refs, float *dist_min) {
+    const UpdateMinTable &table = pts.layout == Layout::AoS
+                                      ? active().update_min_aos
+                                      : active().update_min_soa;
+    table[pts.C <= kMaxFixedDim ? pts.C : 0](pts, begin, end, refs, n_refs,
+                                             dist_min);
+}
+
+// update_min over an SoA cloud that also returns the argmax of the updated
+// range, the first index winning ties as in update_argmax_first.
+inline ArgMax update_min_argmax(const CloudView &pts, size_t begin,
+                                size_t end, const float *refs, size_t n_refs,
+                                float *dist_min) {
+    constexpr size_t kBlock = size_t(1) << 30;
+    const UpdateMinArgmaxFn fn =
+        active().update_min_argmax_soa[pts.C <= kMaxFixedDim ? pts.C : 0];
+    ArgMax best{-1.0f, 0};
+    for (size_t lo = begin; lo < end; lo += kBlock) {
+        size_t hi = (end - lo > kBlock) ? lo + kBlock : end;
+        best = merge<Ties::First>(best,
+                                  fn(pts, lo, hi, refs, n_refs, dist_min));
+    }
+    return best;
+}
+
+} // namespace simd
+
+#endif // FPSAMPLE_SIMD_HPP
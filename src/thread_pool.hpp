@@ -0,0 +1,247 @@
+// Small fork-join worker pool for the per-iteration parallel loops.
+//
+// FPS runs thousands of very short parallel rounds (one per sample), so the
+// workers are started once and then kept spinning on an epoch counter
+// between rounds instead of being woken through a condition variable.
+
+#ifndef FPSAMPLE_THREAD_POOL_HPP
+#define FPSAMPLE_THREAD_POOL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) ||           \
+    defined(_M_IX86)
+#include <immintrin.h>
+#define FPSAMPLE_CPU_RELAX() _mm_pause()
+#else
+#define FPSAMPLE_CPU_RELAX() ((void)0)
+#endif
+
+namespace threading {
+
+// `requested == 0` means one thread per hardware core. The result is capped so
+// that every thread gets at least `min_work` items.
+inline size_t resolve_num_threads(size_t requested, size_t work,
+                                  size_t min_work = 1) {
+    size_t n = requested;
+    if (n == 0)
+        n = std::max<unsigned>(std::thread::hardware_concurrency(), 1u);
+    size_t cap = std::max<size_t>(work / std::max<size_t>(min_work, 1), 1);
+    return std::max<size_t>(std::min(n, cap), 1);
+}
+
+// Contiguous [begin, end) slice of `n` items for thread `tid` of `n_threads`,
+// with slice boundaries rounded to multiples of `align`.
+inline std::pair<size_t, size_t> split_range(size_t n, size_t n_threads,
+                                             size_t tid, size_t align = 1) {
+    size_t per = (n + n_threads - 1) / n_threads;
+    per = (per + align - 1) / align * align;
+    size_t begin = std::min(n, tid * per);
+    size_t end = std::min(n, begin + per);
+    return {begin, end};
+}
+
+class WorkerPool {
+  public:
+    // The calling thread takes part in every round as thread 0, so only
+    // `n_threads - 1` workers are spawned.
+    explicit WorkerPool(size_t n_threads)
+        : n_threads_(std::max<size_t>(n_threads, 1)) {
+        workers_.reserve(n_threads_ - 1);
+        for (size_t tid = 1; tid < n_threads_; ++tid)
+            workers_.emplace_back([this, tid] { worker_loop(tid); });
+    }
+
+    ~WorkerPool() {
+        stop_.store(true, std::memory_order_relaxed);
+        epoch_.fetch_add(1, std::memory_order_release);
+        for (auto &w : workers_)
+            w.join();
+    }
+
+    WorkerPool(const WorkerPool &) = delete;
+    WorkerPool &operator=(const WorkerPool &) = delete;
+
+    size_t size() const { return n_threads_; }
+
+    // Run `fn(tid)` for every tid in [0, size()) and wait for all of them.
+    // `fn` must not throw.
+    template <typename F> void run(F &&fn) {
+        using Fn = std::remove_reference_t<F>;
+        ctx_ = const_cast<void *>(static_cast<const void *>(&fn));
+        invoke_ = [](void *ctx, size_t tid) { (*static_cast<Fn *>(ctx))(tid); };
+        pending_.store(n_threads_ - 1, std::memory_order_relaxed);
+        epoch_.fetch_add(1, std::memory_order_release);
+
+        fn(0);
+
+        size_t spins = 0;
+        while (pending_.load(std::memory_order_acquire) != 0)
+            backoff(spins);
+    }
+
+  private:
+    static void backoff(size_t &spins) {
+        if (++spins < 1024) {
+            FPSAMPLE_CPU_RELAX();
+        } else {
+            std::this_thread::yield();
+        }
+    }
+
+    void worker_loop(size_t tid) {
+        uint64_t seen = 0;
+        for (;;) {
+            size_t spins = 0;
+            uint64_t e;
+            while ((e = epoch_.load(std::memory_order_acquire)) == seen)
+                backoff(spins);
+            seen = e;
+            if (stop_.load(std::memory_order_relaxed))
+                return;
+            invoke_(ctx_, tid);
+            pending_.fetch_sub(1, std::memory_order_acq_rel);
+        }
+    }
+
+    size_t n_threads_;
+    std::vector<std::thread> workers_;
+    void *ctx_ = nullptr;
+    void (*invoke_)(void *, size_t) = nullptr;
+    alignas(64) std::atomic<uint64_t> epoch_{0};
+    alignas(64) std::atomic<size_t> pending_{0};
+    std::atomic<bool> stop_{false};
+};
+
+// Run `fn(i)` for every i in [0, n) on up to `n_threads` threads. Items are
+// handed out one at a time from a shared counter, so items of uneven cost
+// still balance. The first exception thrown by `fn` stops the loop and is
+// rethrown on the calling thread.
+template <typename F>
+void parallel_for_dynamic(size_t n, size_t n_threads, F &&fn) {
+    n_threads = std::max<size_t>(std::min(n_threads, n), 1);
+    std::atomic<size_t> next{0};
+    std::exception_ptr error;
+    std::mutex error_mutex;
+
+    auto body = [&](size_t) {
+        for (;;) {
+            size_t i = next.fetch_add(1, std::memory_order_relaxed);
+            if (i >= n)
+                return;
+            try {
+                fn(i);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                if (!error)
+                    error = std::current_exception();
+                next.store(n, std::memory_order_relaxed);
+            }
+        }
+    };
+
+    if (n_threads == 1) {
+        body(0);
+    } else {
+        WorkerPool pool(n_threads);
+        pool.run(body);
+    }
+    if (error)
+        std::rethrow_exception(error);
+}
+
+// Run `fn(i)` for every i in [0, n) when items have very different costs
+// (`cost(i)` is any estimate). Items are dealt to per-thread queues, largest
+// first, each going to the least loaded queue. A thread works through its own
+// queue from the largest item down. Once its queue is empty it steals the
+// smallest remaining item of another thread, so no thread idles while work
+// is left. Exceptions are handled as in `parallel_for_dynamic`.
+template <typename Cost, typename F>
+void parallel_for_stealing(size_t n, size_t n_threads, Cost &&cost, F &&fn) {
+    n_threads = std::max<size_t>(std::min(n_threads, n), 1);
+
+    std::vector<size_t> order(n);
+    std::vector<double> costs(n);
+    for (size_t i = 0; i < n; ++i) {
+        order[i] = i;
+        costs[i] = static_cast<double>(cost(i));
+    }
+    std::stable_sort(order.begin(), order.end(),
+                     [&](size_t a, size_t b) { return costs[a] > costs[b]; });
+
+    struct alignas(64) Queue {
+        std::mutex mutex;
+        std::deque<size_t> items;
+        double load = 0;
+    };
+    std::vector<Queue> queues(n_threads);
+    for (size_t i : order) {
+        auto least = std::min_element(
+            queues.begin(), queues.end(),
+            [](const Queue &a, const Queue &b) { return a.load < b.load; });
+        least->items.push_back(i);
+        least->load += costs[i];
+    }
+
+    std::atomic<bool> failed{false};
+    std::exception_ptr error;
+    std::mutex error_mutex;
+
+    auto take = [&](size_t tid, size_t &item) {
+        {
+            std::lock_guard<std::mutex> lock(queues[tid].mutex);
+            if (!queues[tid].items.empty()) {
+                item = queues[tid].items.front();
+                queues[tid].items.pop_front();
+                return true;
+            }
+        }
+        for (size_t k = 1; k < n_threads; ++k) {
+            Queue &victim = queues[(tid + k) % n_threads];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.items.empty()) {
+                item = victim.items.back();
+                victim.items.pop_back();
+                return true;
+            }
+        }
+        return false;
+    };
+
+    auto body = [&](size_t tid) {
+        size_t item;
+        while (!failed.load(std::memory_order_relaxed) && take(tid, item)) {
+            try {
+                fn(item);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                if (!error)
+                    error = std::current_exception();
+                failed.store(true, std::memory_order_relaxed);
+            }
+        }
+    };
+
+    if (n_threads == 1) {
+        body(0);
+    } else {
+        WorkerPool pool(n_threads);
+        pool.run(body);
+    }
+    if (error)
+        std::rethrow_exception(error);
+}
+
+} // namespace threading
+
+#endif // FPSAMPLE_THREAD_POOL_HPP
@@ -1,6 +1,13 @@
+#include "_ext/FlatKDLineTree.h"
+#include "_ext/FlatKDTree.h"
 #include "_ext/KDLineTree.h"
 #include "_ext/KDTree.h"
+#include "dispatch.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
 #include <array>
+#include <cstring>
+#include <limits>
 #include <memory>
 #include <utility>
 #include <vector>
@@ -10,124 +17,376 @@
 #endif
 constexpr size_t max_dim = BUCKET_FPS_MAX_DIM;
 
+using quickfps::FlatKDLineTree;
+using quickfps::FlatKDTree;
 using quickfps::KDLineTree;
 using quickfps::KDTree;
 using quickfps::Point;
 
+// Node layout of the bucket engines: KDNode objects linked by pointer and
+// dispatched virtually, or the flattened CRTP trees, which take at most
+// max_flat_points points.
+enum BucketLayout { BUCKET_LAYOUT_POINTER = 0, BUCKET_LAYOUT_FLAT = 1 };
+constexpr size_t max_flat_points = size_t(1) << 31;
+
+// Below this many points per thread a parallel tree build does not pay for
+// its workers.
+constexpr size_t min_build_points_per_thread = size_t(1) << 15;
+
 template <typename T, size_t DIM, typename S>
 std::vector<Point<T, DIM, S>> raw_data_to_points(const float *raw_data,
-                                                 size_t n_points, size_t dim) {
+                                                 size_t n_points, size_t dim,
+                                                 size_t n_threads = 1) {
     std::vector<Point<T, DIM, S>> points;
-    points.reserve(n_points);
-    for (size_t i = 0; i < n_points; i++) {
-        const float *ptr = raw_data + i * dim;
-        points.push_back(Point<T, DIM, S>(ptr, i));
+    if (n_threads <= 1) {
+        points.reserve(n_points);
+        for (size_t i = 0; i < n_points; i++) {
+            const float *ptr = raw_data + i * dim;
+            points.push_back(Point<T, DIM, S>(ptr, i));
+        }
+        return points;
     }
+    points.resize(n_points);
+    threading::WorkerPool pool(n_threads);
+    pool.run([&](size_t tid) {
+        auto range = threading::split_range(n_points, n_threads, tid);
+        for (size_t i = range.first; i < range.second; i++)
+            points[i] = Point<T, DIM, S>(raw_data + i * dim, i);
+    });
     return points;
 }
 
-template <typename T, size_t DIM, typename S = T>
-void kdtree_sample(const float *raw_data, size_t n_points, size_t dim,
-                   size_t n_samples, size_t start_idx,
-                   size_t *sampled_point_indices) {
-    auto points = raw_data_to_points<T, DIM, S>(raw_data, n_points, dim);
+// Copy the per-sample radii and the final distance field out of a sampled
+// tree. Either output may be null.
+template <typename Tree, typename Points>
+void collect_distances(Tree &tree, const Points &sampled_points,
+                       size_t n_samples, float *sampled_point_radii,
+                       float *point_dist_min) {
+    using S = decltype(sampled_points[0].dis);
+    if (sampled_point_radii) {
+        for (size_t i = 0; i < n_samples; i++) {
+            S dis = sampled_points[i].dis;
+            sampled_point_radii[i] = dis == std::numeric_limits<S>::max()
+                                         ? std::numeric_limits<float>::infinity()
+                                         : static_cast<float>(dis);
+        }
+    }
+    if (point_dist_min) {
+        std::vector<S> dist(tree.pointSize);
+        tree.flush(dist.data());
+        std::copy(dist.begin(), dist.end(), point_dist_min);
+    }
+}
+
+template <template <typename, size_t, typename> class Tree, typename T,
+          size_t DIM, typename S = T>
+size_t kdtree_sample(const float *raw_data, size_t n_points, size_t dim,
+                     size_t n_samples, const size_t *start_idx,
+                     size_t n_starts, S stop_dis, size_t num_threads,
+                     size_t *sampled_point_indices, float *sampled_point_radii,
+                     float *point_dist_min) {
+    const size_t n_threads = threading::resolve_num_threads(
+        num_threads, n_points, min_build_points_per_thread);
+    auto points =
+        raw_data_to_points<T, DIM, S>(raw_data, n_points, dim, n_threads);
     std::unique_ptr<Point<T, DIM, S>[]> sampled_points(
         new Point<T, DIM, S>[n_samples]);
-    KDTree<T, DIM, S> tree(points.data(), n_points, sampled_points.get());
-    tree.buildKDtree();
-    tree.init(points[start_idx]);
-    tree.sample(n_samples);
-    for (size_t i = 0; i < n_samples; i++) {
+    Tree<T, DIM, S> tree(points.data(), n_points, sampled_points.get());
+    // buildKDtree() reorders points, so pick the seeds first
+    std::vector<Point<T, DIM, S>> seeds;
+    seeds.reserve(n_starts);
+    for (size_t i = 0; i < n_starts; i++)
+        seeds.push_back(points[start_idx[i]]);
+    tree.buildKDtree(n_threads);
+    tree.init(seeds.data(), n_starts);
+    size_t n_taken = tree.sample(n_samples, stop_dis, n_starts);
+    for (size_t i = 0; i < n_taken; i++) {
         sampled_point_indices[i] = sampled_points[i].id;
     }
+    collect_distances(tree, sampled_points, n_taken, sampled_point_radii,
+                      point_dist_min);
+    return n_taken;
 }
 
-template <typename T, size_t DIM, typename S = T>
-void kdline_sample(const float *raw_data, size_t n_points, size_t dim,
-                   size_t n_samples, size_t start_idx, size_t height,
-                   size_t *sampled_point_indices) {
-    auto points = raw_data_to_points<T, DIM, S>(raw_data, n_points, dim);
+template <template <typename, size_t, typename> class Tree, typename T,
+          size_t DIM, typename S = T>
+size_t kdline_sample(const float *raw_data, size_t n_points, size_t dim,
+                     size_t n_samples, const size_t *start_idx,
+                     size_t n_starts, size_t height, S stop_dis,
+                     size_t num_threads, size_t *sampled_point_indices,
+                     float *sampled_point_radii, float *point_dist_min) {
+    const size_t n_threads = threading::resolve_num_threads(
+        num_threads, n_points, min_build_points_per_thread);
+    auto points =
+        raw_data_to_points<T, DIM, S>(raw_data, n_points, dim, n_threads);
     std::unique_ptr<Point<T, DIM, S>[]> sampled_points(
         new Point<T, DIM, S>[n_samples]);
-    KDLineTree<T, DIM, S> tree(points.data(), n_points, height,
-                               sampled_points.get());
-    tree.buildKDtree();
-    tree.init(points[start_idx]);
-    tree.sample(n_samples);
-    for (size_t i = 0; i < n_samples; i++) {
+    Tree<T, DIM, S> tree(points.data(), n_points, height,
+                         sampled_points.get());
+    // buildKDtree() reorders points, so pick the seeds first
+    std::vector<Point<T, DIM, S>> seeds;
+    seeds.reserve(n_starts);
+    for (size_t i = 0; i < n_starts; i++)
+        seeds.push_back(points[start_idx[i]]);
+    tree.buildKDtree(n_threads);
+    tree.init(seeds.data(), n_starts);
+    size_t n_taken = tree.sample(n_samples, stop_dis, n_starts);
+    for (size_t i = 0; i < n_taken; i++) {
         sampled_point_indices[i] = sampled_points[i].id;
     }
+    collect_distances(tree, sampled_points, n_taken, sampled_point_radii,
+                      point_dist_min);
+    return n_taken;
 }
 
+// FPS whose state survives between calls, so that the sample set can be
+// extended without redoing the work behind the samples already taken.
+class IncrementalSampler {
+  public:
+    virtual ~IncrementalSampler() = default;
+    // Append up to k more samples to out and return how many were taken;
+    // fewer than k only once every point has been sampled.
+    virtual size_t next(size_t k, size_t *out) = 0;
+    // Number of samples taken so far.
+    virtual size_t size() const = 0;
+};
+
+// Keeps the KD tree with its delayed updates, so next() resumes the bucket
+// FPS exactly where the previous call stopped.
+template <typename Tree, typename T, size_t DIM, typename S = T>
+class TreeIncrementalSampler : public IncrementalSampler {
+  public:
+    template <typename... Args>
+    TreeIncrementalSampler(const float *raw_data, size_t n_points, size_t dim,
+                           size_t start_idx, Args... tree_args)
+        : points_(raw_data_to_points<T, DIM, S>(raw_data, n_points, dim)),
+          sampled_(1),
+          tree_(points_.data(), n_points, tree_args..., sampled_.data()) {
+        // buildKDtree() reorders points_, so take the start point first
+        Point<T, DIM, S> start = points_[start_idx];
+        tree_.buildKDtree();
+        tree_.init(start);
+    }
+
+    size_t next(size_t k, size_t *out) override {
+        size_t first = taken_;
+        size_t total = std::min(taken_ + k, points_.size());
+        if (total == first)
+            return 0;
+        sampled_.resize(total);
+        tree_.sample_points = sampled_.data();
+        // the start point was placed by init()
+        taken_ = tree_.sample(total, 0, std::max<size_t>(first, 1));
+        for (size_t i = first; i < taken_; i++)
+            out[i - first] = sampled_[i].id;
+        return taken_ - first;
+    }
+
+    size_t size() const override { return taken_; }
+
+  private:
+    std::vector<Point<T, DIM, S>> points_;
+    std::vector<Point<T, DIM, S>> sampled_;
+    Tree tree_;
+    size_t taken_ = 0;
+};
+
 ////////////////////////////////////////
 //                                    //
 //    Compile Time Function Helper    //
 //                                    //
 ////////////////////////////////////////
-using KDTreeFuncType = void (*)(const float *, size_t, size_t, size_t, size_t,
-                                size_t *);
-using KDLineFuncType = void (*)(const float *, size_t, size_t, size_t, size_t,
-                                size_t, size_t *);
-
-template <typename T, size_t Count, typename M, size_t... I>
-constexpr std::array<T, Count> mapIndices(M &&m, std::index_sequence<I...>) {
-    std::array<T, Count> result{m.template operator()<I + 1>()...};
-    return result;
-}
+using KDTreeFuncType = size_t (*)(const float *, size_t, size_t, size_t,
+                                  const size_t *, size_t, float, size_t,
+                                  size_t *, float *, float *);
+using KDLineFuncType = size_t (*)(const float *, size_t, size_t, size_t,
+                                  const size_t *, size_t, size_t, float,
+                                  size_t, size_t *, float *, float *);
 
-template <typename T, size_t Count, typename M>
-constexpr std::array<T, Count> map(M m) {
-    return mapIndices<T, Count>(m, std::make_index_sequence<Count>());
-}
-
-template <typename T, typename S = T> struct kdtree_func_helper {
+template <template <typename, size_t, typename> class Tree, typename T,
+          typename S = T>
+struct kdtree_func_helper {
     template <size_t DIM> KDTreeFuncType operator()() {
-        return &kdtree_sample<T, DIM, S>;
+        return &kdtree_sample<Tree, T, DIM, S>;
     }
 };
 
-template <typename T, typename S = T> struct kdline_func_helper {
+template <template <typename, size_t, typename> class Tree, typename T,
+          typename S = T>
+struct kdline_func_helper {
     template <size_t DIM> KDLineFuncType operator()() {
-        return &kdline_sample<T, DIM, S>;
+        return &kdline_sample<Tree, T, DIM, S>;
+    }
+};
+
+using IncrementalFuncType = std::unique_ptr<IncrementalSampler> (*)(
+    const float *, size_t, size_t, size_t, size_t);
+
+template <typename T, typename S = T> struct incremental_func_helper {
+    // height == 0 selects the KDTree, anything else a KDLineTree of that
+    // height
+    template <size_t DIM> IncrementalFuncType operator()() {
+        return [](const float *raw_data, size_t n_points, size_t dim,
+                  size_t start_idx,
+                  size_t height) -> std::unique_ptr<IncrementalSampler> {
+            if (height == 0)
+                return std::make_unique<
+                    TreeIncrementalSampler<KDTree<T, DIM, S>, T, DIM, S>>(
+                    raw_data, n_points, dim, start_idx);
+            return std::make_unique<
+                TreeIncrementalSampler<KDLineTree<T, DIM, S>, T, DIM, S>>(
+                raw_data, n_points, dim, start_idx, height);
+        };
     }
 };
 
+// Incremental bucket FPS over a copy of raw_data, for 1 to max_dim
+// dimensions and start_idx < n_points (checked by the caller).
+inline std::unique_ptr<IncrementalSampler>
+make_bucket_incremental_sampler(const float *raw_data, size_t n_points,
+                                size_t dim, size_t start_idx, size_t height) {
+    static const auto func_arr =
+        map<IncrementalFuncType, max_dim>(incremental_func_helper<float>{});
+    return func_arr[dim - 1](raw_data, n_points, dim, start_idx, height);
+}
+
 /////////////////
 //             //
 //    C API    //
 //             //
 /////////////////
 
+// Settings and optional outputs of the *_ex entry points. Callers zero the
+// struct, set `size` to sizeof(BucketFpsOptions) and fill in what they need.
+// Only the first `size` bytes are read, so fields appended in later versions
+// keep their zero default for callers built against this one; new fields
+// always go at the end.
+struct BucketFpsOptions {
+    size_t size;
+    // Stop once every point is closer than this to a sample; 0 never stops.
+    float radius;
+    // A BucketLayout.
+    int layout;
+    // Threads used to build the tree, 0 for one per core. The samples do not
+    // depend on it.
+    size_t num_threads;
+    // Optional, may be null: the squared insertion radius of every sample
+    // (inf for the first one), n_samples entries...
+    float *sampled_point_radii;
+    // ...and the final squared distance of every point to the sample set,
+    // n_points entries.
+    float *point_dist_min;
+};
+
+// The fields of `options` the caller knows of, the others left at zero. A
+// null `options` gives all defaults.
+inline BucketFpsOptions read_options(const BucketFpsOptions *options) {
+    BucketFpsOptions opts{};
+    if (options)
+        std::memcpy(&opts, options, std::min(options->size, sizeof(opts)));
+    opts.size = sizeof(opts);
+    return opts;
+}
+
+// The *_ex variants take n_starts >= 1 seed indices, which become the first
+// samples, and report the number of samples taken in *n_sampled, which is
+// below n_samples only if options->radius stopped the sampling early.
 extern "C" {
-int bucket_fps_kdtree(const float *raw_data, size_t n_points, size_t dim,
-                      size_t n_samples, size_t start_idx,
-                      size_t *sampled_point_indices) {
+int bucket_fps_kdtree_ex(const float *raw_data, size_t n_points, size_t dim,
+                         size_t n_samples, const size_t *start_idx,
+                         size_t n_starts, const BucketFpsOptions *options,
+                         size_t *sampled_point_indices, size_t *n_sampled) {
+    const BucketFpsOptions opts = read_options(options);
     if (dim == 0 || dim > max_dim) {
         // only support 1 to MAX_DIM dimensions
         return 1;
-    } else if (start_idx >= n_points) {
-        // start_idx should be smaller than n_samples
-        return 2;
     }
-    auto func_arr = map<KDTreeFuncType, max_dim>(kdtree_func_helper<float>{});
-    func_arr[dim - 1](raw_data, n_points, dim, n_samples, start_idx,
-                      sampled_point_indices);
+    for (size_t i = 0; i < n_starts; i++) {
+        if (start_idx[i] >= n_points) {
+            // start_idx should be smaller than n_points
+            return 2;
+        }
+    }
+    if (n_starts == 0 || n_starts > n_samples) {
+        // need 1 to n_samples seeds
+        return 3;
+    }
+    if (opts.layout != BUCKET_LAYOUT_POINTER &&
+        (opts.layout != BUCKET_LAYOUT_FLAT || n_points > max_flat_points)) {
+        // unknown layout, or too many points for the flat one
+        return 4;
+    }
+    auto func_arr =
+        opts.layout == BUCKET_LAYOUT_FLAT
+            ? map<KDTreeFuncType, max_dim>(kdtree_func_helper<FlatKDTree, float>{})
+            : map<KDTreeFuncType, max_dim>(kdtree_func_helper<KDTree, float>{});
+    *n_sampled = func_arr[dim - 1](raw_data, n_points, dim, n_samples,
+                                   start_idx, n_starts,
+                                   opts.radius * opts.radius, opts.num_threads,
+                                   sampled_point_indices,
+                                   opts.sampled_point_radii,
+                                   opts.point_dist_min);
     return 0;
 }
 
-int bucket_fps_kdline(const float *raw_data, size_t n_points, size_t dim,
-                      size_t n_samples, size_t start_idx, size_t height,
-                      size_t *sampled_point_indices) {
+int bucket_fps_kdline_ex(const float *raw_data, size_t n_points, size_t dim,
+                         size_t n_samples, const size_t *start_idx,
+                         size_t n_starts, size_t height,
+                         const BucketFpsOptions *options,
+                         size_t *sampled_point_indices, size_t *n_sampled) {
+    const BucketFpsOptions opts = read_options(options);
     if (dim == 0 || dim > max_dim) {
         // only support 1 to MAX_DIM dimensions
         return 1;
-    } else if (start_idx >= n_points) {
-        // start_idx should be smaller than n_samples
-        return 2;
     }
-    auto func_arr = map<KDLineFuncType, max_dim>(kdline_func_helper<float>{});
-    func_arr[dim - 1](raw_data, n_points, dim, n_samples, start_idx, height,
-                      sampled_point_indices);
+    for (size_t i = 0; i < n_starts; i++) {
+        if (start_idx[i] >= n_points) {
+            // start_idx should be smaller than n_points
+            return 2;
+        }
+    }
+    if (n_starts == 0 || n_starts > n_samples) {
+        // need 1 to n_samples seeds
+        return 3;
+    }
+    if (opts.layout != BUCKET_LAYOUT_POINTER &&
+        (opts.layout != BUCKET_LAYOUT_FLAT || n_points > max_flat_points)) {
+        // unknown layout, or too many points for the flat one
+        return 4;
+    }
+    auto func_arr =
+        opts.layout == BUCKET_LAYOUT_FLAT
+            ? map<KDLineFuncType, max_dim>(kdline_func_helper<FlatKDLineTree, float>{})
+            : map<KDLineFuncType, max_dim>(kdline_func_helper<KDLineTree, float>{});
+    *n_sampled = func_arr[dim - 1](raw_data, n_points, dim, n_samples,
+                                   start_idx, n_starts, height,
+                                   opts.radius * opts.radius, opts.num_threads,
+                                   sampled_point_indices,
+                                   opts.sampled_point_radii,
+                                   opts.point_dist_min);
     return 0;
 }
+
+int bucket_fps_kdtree(const float *raw_data, size_t n_points, size_t dim,
+                      size_t n_samples, size_t start_idx,
+                      size_t *sampled_point_indices) {
+    BucketFpsOptions opts{};
+    opts.size = sizeof(opts);
+    opts.num_threads = 1;
+    size_t n_sampled;
+    return bucket_fps_kdtree_ex(raw_data, n_points, dim, n_samples, &start_idx,
+                                1, &opts, sampled_point_indices, &n_sampled);
+}
+
+int bucket_fps_kdline(const float *raw_data, size_t n_points, size_t dim,
+                      size_t n_samples, size_t start_idx, size_t height,
+                      size_t *sampled_point_indices) {
+    BucketFpsOptions opts{};
+    opts.size = sizeof(opts);
+    opts.num_threads = 1;
+    size_t n_sampled;
+    return bucket_fps_kdline_ex(raw_data, n_points, dim, n_samples, &start_idx,
+                                1, height, &opts, sampled_point_indices,
+                                &n_sampled);
+}
 }